@@ -0,0 +1,103 @@
+#ifndef ITER_BUFFER_GROUP_HPP
+#define ITER_BUFFER_GROUP_HPP
+
+#include <iter/epoch_buffer.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+namespace iter {
+
+// Replace the elements of the tuple of pointers with the non-null ones.
+template<size_t Index, size_t Size>
+struct TupleMerger {
+    template<class Tuple>
+    static void Merge(const Tuple& changes, Tuple* result) {
+        if (std::get<Index>(changes)) std::get<Index>(*result) = std::get<Index>(changes);
+        TupleMerger<Index + 1, Size>::Merge(changes, result);
+    }
+};
+
+template<size_t Size>
+struct TupleMerger<Size, Size> {
+    template<class Tuple>
+    static void Merge(const Tuple&, Tuple*) {}
+};
+
+// Several related buffers published together as one version, e.g. an
+// index, a dictionary and a model, so the readers never see a new index
+// with an old dictionary. The readers take one lock-free snapshot of all
+// the buffers from the underlying EpochBuffer. e.g.
+//     BufferGroup<Index, Dict> group;
+//     group.Update(new_index, new_dict);
+//     auto ptr = group.Read();
+//     const Index& index = *std::get<0>(*ptr);
+//     const Dict& dict = *std::get<1>(*ptr);
+// The buffers are shared by the versions, the unchanged ones are not
+// copied. Buffers MUST have no-arguments constructors.
+template<class... Buffers>
+class BufferGroup {
+public:
+    // The buffers of one version.
+    typedef std::tuple<std::shared_ptr<const Buffers>...> Version;
+    typedef typename EpochBuffer<Version>::ReadPtr ReadPtr;
+
+    // The changes published together by Commit.
+    class Transaction {
+    public:
+        // Replace the buffer at the index.
+        template<size_t Index>
+        void Set(const typename std::tuple_element<Index, Version>::type& buffer) {
+            std::get<Index>(changes_) = buffer;
+        }
+
+    private:
+        friend class BufferGroup;
+
+        // The null ones are not changed.
+        Version changes_;
+    };
+
+    // The max_versions is same as EpochBuffer.
+    explicit BufferGroup(size_t max_versions = 4) : version_(max_versions) {
+        version_.Update(Version(std::shared_ptr<const Buffers>(new Buffers())...));
+    }
+
+    // Get the snapshot of all the buffers, keep it short-lived like the
+    // ReadPtr of EpochBuffer.
+    ReadPtr Read() { return version_.Read(); }
+
+    // Publish all the buffers, the null ones are not changed.
+    void Update(const std::shared_ptr<const Buffers>&... buffers) {
+        Publish(Version(buffers...));
+    }
+
+    // Publish the changes of the transaction.
+    void Commit(const Transaction& transaction) {
+        Publish(transaction.changes_);
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    BufferGroup(const BufferGroup&) = delete;
+    BufferGroup& operator = (const BufferGroup&) = delete;
+
+private:
+    void Publish(const Version& changes) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        std::unique_ptr<Version> version(new Version(*version_.Read()));
+        TupleMerger<0, sizeof...(Buffers)>::Merge(changes, version.get());
+        version_.Update(std::move(version));
+    }
+
+private:
+    EpochBuffer<Version> version_;
+    // The updates are merged onto the latest version one by one.
+    std::mutex mtx_;
+};
+
+} // namespace iter
+
+#endif // ITER_BUFFER_GROUP_HPP
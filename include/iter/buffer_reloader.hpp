@@ -0,0 +1,295 @@
+#ifndef ITER_BUFFER_RELOADER_HPP
+#define ITER_BUFFER_RELOADER_HPP
+
+#include <iter/double_buffer.hpp>
+#include <iter/thread_pool.hpp>
+#include <iter/time_keeper.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace iter {
+
+// The result of the last reload.
+struct ReloadResult {
+    bool success;
+    // The reason of the failure.
+    std::string error;
+    // The time to load and publish the buffer, in milliseconds.
+    double elapsed_ms;
+    // The number of reloads since constructed, including the failed ones.
+    uint64_t reload_count;
+    uint64_t failure_count;
+
+    ReloadResult() : success(false), elapsed_ms(0), reload_count(0),
+        failure_count(0) {}
+};
+
+// Reload the double buffer from a file when it changes, e.g. a dictionary
+// or a model. The next buffer is built by the loader in the thread pool,
+// and published by DoubleBuffer::UpdateWait. The changes within the
+// debounce time are merged into one reload. e.g.
+//     BufferReloader<Dict> reloader(&db, &pool, "dict.txt",
+//         [](const std::string& path, Dict* dict) { return dict->Load(path); });
+//     reloader.Reload().get();
+//     reloader.Start();
+// The file is watched by inotify on its directory, so replacing the file
+// by rename is detected too.
+template<class Buffer>
+class BufferReloader {
+public:
+    // Build the buffer from the file, return false when failed.
+    typedef std::function<bool(const std::string& path, Buffer* buffer)> Loader;
+    // Called after each reload in the thread pool.
+    typedef std::function<void(const ReloadResult& result)> Callback;
+
+    // The double buffer and the thread pool MUST outlive the reloader.
+    BufferReloader(DoubleBuffer<Buffer>* double_buffer, ThreadPool* pool,
+        const std::string& path, const Loader& loader,
+        const Callback& callback = Callback(),
+        const std::chrono::milliseconds& debounce = std::chrono::milliseconds(200));
+
+    // Stop watching and wait for the reloads in progress.
+    ~BufferReloader();
+
+    // Start watching the file in a background thread.
+    // Return false when the directory can not be watched.
+    bool Start();
+
+    void Stop();
+
+    // Reload the file in the thread pool now, regardless of changes.
+    // The future is true when the buffer is published.
+    std::future<bool> Reload();
+
+    ReloadResult LastResult() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return last_result_;
+    }
+
+    // How long to wait for the readers of the reserved buffer before the
+    // reload fails, 10 seconds by default.
+    void SetUpdateTimeout(const std::chrono::milliseconds& timeout) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        update_timeout_ = timeout;
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    BufferReloader(const BufferReloader&) = delete;
+    BufferReloader& operator = (const BufferReloader&) = delete;
+
+private:
+    // Watch the file until stopped.
+    void Watch();
+
+    // Read the inotify events, return true when the file is changed.
+    bool ReadEvents();
+
+    // Load the file and publish it.
+    bool Load();
+
+    // Finish the reload in progress even if it throws. Notify under the
+    // lock, the reloader may be destroyed once loading_ is 0.
+    struct LoadingGuard {
+        BufferReloader* reloader;
+
+        ~LoadingGuard() {
+            std::lock_guard<std::mutex> lck(reloader->mtx_);
+            reloader->loading_--;
+            reloader->cv_.notify_all();
+        }
+    };
+
+private:
+    DoubleBuffer<Buffer>* double_buffer_;
+    ThreadPool* pool_;
+    std::string path_;
+    std::string dir_;
+    std::string file_name_;
+    Loader loader_;
+    Callback callback_;
+    std::chrono::milliseconds debounce_;
+    std::chrono::milliseconds update_timeout_;
+
+    int inotify_fd_;
+    // Written to wake up the watcher when stopping.
+    int stop_pipe_[2];
+    std::thread watcher_;
+
+    ReloadResult last_result_;
+    // The reloads pushed to the thread pool and not finished.
+    int loading_;
+    // Only one reload runs at a time.
+    std::mutex load_mtx_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+template<class Buffer>
+BufferReloader<Buffer>::BufferReloader(DoubleBuffer<Buffer>* double_buffer,
+        ThreadPool* pool, const std::string& path, const Loader& loader,
+        const Callback& callback, const std::chrono::milliseconds& debounce) :
+        double_buffer_(double_buffer), pool_(pool), path_(path), loader_(loader),
+        callback_(callback), debounce_(debounce), update_timeout_(10000),
+        inotify_fd_(-1), loading_(0) {
+    stop_pipe_[0] = stop_pipe_[1] = -1;
+    size_t pos = path_.rfind('/');
+    dir_ = pos == std::string::npos ? "." : path_.substr(0, std::max<size_t>(pos, 1));
+    file_name_ = pos == std::string::npos ? path_ : path_.substr(pos + 1);
+}
+
+template<class Buffer>
+BufferReloader<Buffer>::~BufferReloader() {
+    Stop();
+    std::unique_lock<std::mutex> lck(mtx_);
+    cv_.wait(lck, [this] { return loading_ == 0; });
+}
+
+template<class Buffer>
+bool BufferReloader<Buffer>::Start() {
+    if (watcher_.joinable()) return true;
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) return false;
+    if (inotify_add_watch(inotify_fd_, dir_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0
+            || pipe2(stop_pipe_, O_CLOEXEC) != 0) {
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+        return false;
+    }
+    watcher_ = std::thread(&BufferReloader::Watch, this);
+    return true;
+}
+
+template<class Buffer>
+void BufferReloader<Buffer>::Stop() {
+    if (!watcher_.joinable()) return;
+    char c = 0;
+    while (write(stop_pipe_[1], &c, 1) < 0 && errno == EINTR);
+    watcher_.join();
+    close(inotify_fd_);
+    close(stop_pipe_[0]);
+    close(stop_pipe_[1]);
+    inotify_fd_ = stop_pipe_[0] = stop_pipe_[1] = -1;
+}
+
+template<class Buffer>
+std::future<bool> BufferReloader<Buffer>::Reload() {
+    { // Critical region.
+        std::lock_guard<std::mutex> lck(mtx_);
+        loading_++;
+    }
+    std::future<bool> result = pool_->PushTask([this] {
+        LoadingGuard guard{this};
+        return Load();
+    });
+    // The thread pool is shutdown.
+    if (!result.valid()) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        loading_--;
+    }
+    return result;
+}
+
+template<class Buffer>
+void BufferReloader<Buffer>::Watch() {
+    using namespace std::chrono;
+    pollfd fds[2];
+    fds[0].fd = inotify_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = stop_pipe_[0];
+    fds[1].events = POLLIN;
+    bool pending = false;
+    steady_clock::time_point deadline;
+    while (true) {
+        int timeout = -1;
+        if (pending) {
+            timeout = std::max<int>(0, duration_cast<milliseconds>(
+                deadline - steady_clock::now()).count() + 1);
+        }
+        int ret = poll(fds, 2, timeout);
+        if (ret < 0 && errno != EINTR) return;
+        if (ret > 0 && (fds[1].revents & POLLIN)) return;
+        if (ret > 0 && (fds[0].revents & POLLIN) && ReadEvents()) {
+            // Wait until the file is quiet for the debounce time.
+            pending = true;
+            deadline = steady_clock::now() + debounce_;
+        }
+        if (pending && steady_clock::now() >= deadline) {
+            pending = false;
+            Reload();
+        }
+    }
+}
+
+template<class Buffer>
+bool BufferReloader<Buffer>::ReadEvents() {
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+    while (true) {
+        ssize_t len = read(inotify_fd_, buffer, sizeof(buffer));
+        if (len <= 0) break;
+        for (ssize_t pos = 0; pos < len; ) {
+            const inotify_event* event =
+                reinterpret_cast<const inotify_event*>(buffer + pos);
+            if (event->len > 0 && file_name_ == event->name) changed = true;
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+template<class Buffer>
+bool BufferReloader<Buffer>::Load() {
+    std::lock_guard<std::mutex> load_lck(load_mtx_);
+    std::chrono::milliseconds update_timeout;
+    { // Critical region.
+        std::lock_guard<std::mutex> lck(mtx_);
+        update_timeout = update_timeout_;
+    }
+    TimeKeeper tk;
+    std::string error;
+    try {
+        std::unique_ptr<Buffer> buffer(new Buffer());
+        if (!loader_(path_, buffer.get())) {
+            error = "failed to load " + path_;
+        }
+        else if (!double_buffer_->UpdateWait(std::move(buffer), update_timeout)) {
+            error = "timeout waiting for the readers of the reserved buffer";
+        }
+    }
+    catch (const std::exception& e) {
+        error = e.what();
+    }
+    ReloadResult result;
+    { // Critical region.
+        std::lock_guard<std::mutex> lck(mtx_);
+        last_result_.success = error.empty();
+        last_result_.error = error;
+        last_result_.elapsed_ms = tk.GetElapsedTime<double>();
+        last_result_.reload_count++;
+        if (!error.empty()) last_result_.failure_count++;
+        result = last_result_;
+    }
+    if (callback_) callback_(result);
+    return result.success;
+}
+
+} // namespace iter
+
+#endif // ITER_BUFFER_RELOADER_HPP
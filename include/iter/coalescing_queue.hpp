@@ -0,0 +1,171 @@
+#ifndef ITER_COALESCING_QUEUE_HPP
+#define ITER_COALESCING_QUEUE_HPP
+
+#include <iter/safe_queue.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace iter {
+
+// Replace the pending value with the incoming one.
+template<class Value>
+struct ReplaceMerge {
+    void operator () (Value* pending, Value&& incoming) const {
+        *pending = std::move(incoming);
+    }
+};
+
+// A FIFO queue of key-value pairs, each key is pending at most once.
+// Pushing a key which is already pending merges the value into the pending
+// one and keeps its position, so consumers see each key once per drain.
+// Merge is called as merge(Value* pending, Value&& incoming).
+template<class Key, class Value,
+        class Merge = ReplaceMerge<Value>,
+        class Hash = std::hash<Key>>
+class CoalescingQueue {
+public:
+    typedef Key KeyType;
+    typedef Value ValueType;
+    typedef std::list<std::pair<Key, Value>> QueueType;
+
+    explicit CoalescingQueue(const Merge& merge = Merge()) :
+        closed_(false), coalesced_(0), merge_(merge), queue_ptr_(new QueueType()) {}
+
+    ~CoalescingQueue() { Close(); }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return index_.size();
+    }
+
+    bool Empty() { return Size() == 0; }
+
+    // The number of pushes merged into the pending ones.
+    uint64_t Coalesced() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return coalesced_;
+    }
+
+    // Same as SafeQueue::Close.
+    void Close() {
+        { // Critical region.
+            std::lock_guard<std::mutex> lck(mtx_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    bool IsClosed() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return closed_;
+    }
+
+    // Return false when the queue is closed, the value is discarded.
+    bool Push(const Key& key, const Value& val) {
+        return PushImpl(key, Value(val));
+    }
+
+    bool Push(const Key& key, Value&& val) {
+        return PushImpl(key, std::move(val));
+    }
+
+    // Get the pair in the front of the queue and pop it.
+    // Return false when the queue is empty.
+    bool Pop(Key* key, Value* result) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        if (queue_ptr_->empty()) return false;
+        Take(key, result);
+        return true;
+    }
+
+    // Pop the whole queue, it is one drain cycle.
+    std::unique_ptr<QueueType> PopAll() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        std::unique_ptr<QueueType> result(new QueueType());
+        std::swap(result, queue_ptr_);
+        index_.clear();
+        return result;
+    }
+
+    // Same as SafeQueue::Get.
+    bool Get(Key* key, Value* result) {
+        std::unique_lock<std::mutex> lck(mtx_);
+        cv_.wait(lck, [this] { return closed_ || !queue_ptr_->empty(); });
+        if (queue_ptr_->empty()) return false;
+        Take(key, result);
+        return true;
+    }
+
+    template<class Rep, class Period>
+    QueueStatus GetFor(Key* key, Value* result,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        using namespace std::chrono;
+        return GetUntil(key, result,
+            steady_clock::now() + duration_cast<steady_clock::duration>(timeout));
+    }
+
+    QueueStatus GetUntil(Key* key, Value* result,
+            const std::chrono::steady_clock::time_point& deadline) {
+        std::unique_lock<std::mutex> lck(mtx_);
+        cv_.wait_until(lck, deadline,
+            [this] { return closed_ || !queue_ptr_->empty(); });
+        if (queue_ptr_->empty()) {
+            return closed_ ? QueueStatus::kClosed : QueueStatus::kTimeout;
+        }
+        Take(key, result);
+        return QueueStatus::kSuccess;
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    CoalescingQueue(const CoalescingQueue&) = delete;
+    CoalescingQueue& operator = (const CoalescingQueue&) = delete;
+
+private:
+    bool PushImpl(const Key& key, Value&& val) {
+        { // Critical region.
+            std::lock_guard<std::mutex> lck(mtx_);
+            if (closed_) return false;
+            auto iter = index_.find(key);
+            if (iter != index_.end()) {
+                merge_(&iter->second->second, std::move(val));
+                coalesced_++;
+                return true;
+            }
+            queue_ptr_->emplace_back(key, std::move(val));
+            index_.emplace(key, std::prev(queue_ptr_->end()));
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    void Take(Key* key, Value* result) {
+        auto& front = queue_ptr_->front();
+        index_.erase(front.first);
+        if (key != NULL) *key = std::move(front.first);
+        if (result != NULL) *result = std::move(front.second);
+        queue_ptr_->pop_front();
+    }
+
+private:
+    bool closed_;
+    uint64_t coalesced_;
+    Merge merge_;
+    std::unique_ptr<QueueType> queue_ptr_;
+    // The position of each pending key in the queue.
+    std::unordered_map<Key, typename QueueType::iterator, Hash> index_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+} // namespace iter
+
+#endif // ITER_COALESCING_QUEUE_HPP
@@ -0,0 +1,130 @@
+#ifndef ITER_CONCURRENT_REGISTRY_HPP
+#define ITER_CONCURRENT_REGISTRY_HPP
+
+#include <iter/epoch_buffer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace iter {
+
+// A registry for read-mostly lookups, e.g. sessions looked up on every
+// request. The lookups take no lock, each shard keeps an immutable map
+// in EpochBuffer and the writers publish a new copy of the shard. The
+// writers of different shards do not contend. Get returns the reference
+// counted node instead of copying it, it stays valid after removed.
+// Handle MUST be integral.
+template<class Node, class Handle = int, class Hash = std::hash<Handle>>
+class ConcurrentRegistry {
+    static_assert(std::is_integral<Handle>::value,
+        "Handle of ConcurrentRegistry must be integral.");
+
+public:
+    typedef std::shared_ptr<const Node> NodePtr;
+
+    // If shard_num < 1, it will be fixed to 1.
+    explicit ConcurrentRegistry(size_t shard_num = 16);
+
+    // Return the handle of this node, the handles start from 1.
+    Handle Register(const Node& node) { return Insert(std::make_shared<const Node>(node)); }
+    Handle Register(Node&& node) {
+        return Insert(std::make_shared<const Node>(std::move(node)));
+    }
+
+    // Return false if the handle is not registered.
+    bool Remove(Handle handle);
+
+    // Check whether it is registered, lock-free.
+    bool IsRegistered(Handle handle) {
+        auto map = GetShard(handle)->map.Read();
+        return map->find(handle) != map->end();
+    }
+
+    // Get the node corresponding to the handle, lock-free.
+    // Return nullptr if it is not registered.
+    NodePtr Get(Handle handle) {
+        auto map = GetShard(handle)->map.Read();
+        auto iter = map->find(handle);
+        return iter == map->end() ? NodePtr() : iter->second;
+    }
+
+    // The number of registered nodes.
+    size_t Size();
+
+    // Disable copy constructor and copy assignment operator.
+    ConcurrentRegistry(const ConcurrentRegistry&) = delete;
+    ConcurrentRegistry& operator = (const ConcurrentRegistry&) = delete;
+
+private:
+    typedef std::unordered_map<Handle, NodePtr, Hash> Map;
+
+    struct Shard {
+        EpochBuffer<Map> map;
+        // Serialize the writers of the shard.
+        std::mutex mtx;
+    };
+
+    Shard* GetShard(Handle handle) {
+        return shard_list_[Hash()(handle) % shard_list_.size()].get();
+    }
+
+    Handle Insert(NodePtr&& node);
+
+private:
+    std::atomic<Handle> register_handle_counter_;
+    std::vector<std::unique_ptr<Shard>> shard_list_;
+};
+
+template<class Node, class Handle, class Hash>
+ConcurrentRegistry<Node, Handle, Hash>::ConcurrentRegistry(size_t shard_num) :
+        register_handle_counter_(0) {
+    shard_num = std::max<size_t>(shard_num, 1);
+    for (size_t i = 0; i < shard_num; i++) {
+        shard_list_.emplace_back(new Shard());
+    }
+}
+
+template<class Node, class Handle, class Hash>
+Handle ConcurrentRegistry<Node, Handle, Hash>::Insert(NodePtr&& node) {
+    Handle handle = ++register_handle_counter_;
+    Shard* shard = GetShard(handle);
+    std::lock_guard<std::mutex> lck(shard->mtx);
+    // Copy on write, only the pointers of the nodes are copied.
+    std::unique_ptr<Map> map(new Map(*shard->map.Read()));
+    map->emplace(handle, std::move(node));
+    shard->map.Update(std::move(map));
+    return handle;
+}
+
+template<class Node, class Handle, class Hash>
+bool ConcurrentRegistry<Node, Handle, Hash>::Remove(Handle handle) {
+    Shard* shard = GetShard(handle);
+    std::lock_guard<std::mutex> lck(shard->mtx);
+    std::unique_ptr<Map> map;
+    { // Leave before Update, which may wait for the readers.
+        auto cur = shard->map.Read();
+        if (cur->find(handle) == cur->end()) return false;
+        map.reset(new Map(*cur));
+    }
+    map->erase(handle);
+    shard->map.Update(std::move(map));
+    return true;
+}
+
+template<class Node, class Handle, class Hash>
+size_t ConcurrentRegistry<Node, Handle, Hash>::Size() {
+    size_t size = 0;
+    for (auto& shard : shard_list_) size += shard->map.Read()->size();
+    return size;
+}
+
+} // namespace iter
+
+#endif // ITER_CONCURRENT_REGISTRY_HPP
@@ -0,0 +1,184 @@
+#ifndef ITER_DELAY_QUEUE_HPP
+#define ITER_DELAY_QUEUE_HPP
+
+#include <iter/safe_queue.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace iter {
+
+// Each element becomes available at its due time, the elements are
+// fetched in the order of due time, and FIFO when the due time is equal.
+template<class Value>
+class DelayQueue {
+public:
+    typedef Value ValueType;
+    typedef std::chrono::steady_clock Clock;
+
+    DelayQueue() : closed_(false), seq_(0) {}
+
+    ~DelayQueue() { Close(); }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return queue_.size();
+    }
+
+    bool Empty() { return Size() == 0; }
+
+    // Same as SafeQueue::Close, the remaining elements are still
+    // fetched at their due time.
+    void Close() {
+        { // Critical region.
+            std::lock_guard<std::mutex> lck(mtx_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    bool IsClosed() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return closed_;
+    }
+
+    // Return false when the queue is closed, the value is discarded.
+    bool Push(const Value& val, const Clock::time_point& due) {
+        return PushImpl(val, due);
+    }
+
+    bool Push(Value&& val, const Clock::time_point& due) {
+        return PushImpl(std::move(val), due);
+    }
+
+    // Push the element which is available after the delay.
+    template<class Rep, class Period>
+    bool Push(const Value& val, const std::chrono::duration<Rep, Period>& delay) {
+        return PushImpl(val, Deadline(delay));
+    }
+
+    template<class Rep, class Period>
+    bool Push(Value&& val, const std::chrono::duration<Rep, Period>& delay) {
+        return PushImpl(std::move(val), Deadline(delay));
+    }
+
+    // Get the earliest element and pop it if it is due.
+    // Return false when there is no due element.
+    bool Pop(Value* result) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        if (queue_.empty() || queue_.top().due > Clock::now()) return false;
+        Take(result);
+        return true;
+    }
+
+    // Get the earliest element and pop it, it will be BLOCKED until the
+    // element is due, without polling.
+    // Return false only when the queue is closed and drained.
+    bool Get(Value* result) {
+        return GetUntil(result, Clock::time_point::max()) == QueueStatus::kSuccess;
+    }
+
+    // Get with timeout.
+    template<class Rep, class Period>
+    QueueStatus GetFor(Value* result,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        return GetUntil(result, Deadline(timeout));
+    }
+
+    QueueStatus GetUntil(Value* result, const Clock::time_point& deadline) {
+        std::unique_lock<std::mutex> lck(mtx_);
+        while (true) {
+            if (queue_.empty()) {
+                if (closed_) return QueueStatus::kClosed;
+                if (deadline == Clock::time_point::max()) cv_.wait(lck);
+                else if (cv_.wait_until(lck, deadline) == std::cv_status::timeout
+                        && queue_.empty()) {
+                    return closed_ ? QueueStatus::kClosed : QueueStatus::kTimeout;
+                }
+                continue;
+            }
+            Clock::time_point due = queue_.top().due;
+            if (due <= Clock::now()) break;
+            if (deadline <= due) {
+                // The earliest element will not be due before the deadline,
+                // but an earlier one may be pushed in the meantime.
+                if (cv_.wait_until(lck, deadline) == std::cv_status::timeout
+                        && (queue_.empty() || queue_.top().due > deadline)) {
+                    return QueueStatus::kTimeout;
+                }
+                continue;
+            }
+            // Sleep exactly until the earliest due time.
+            cv_.wait_until(lck, due);
+        }
+        Take(result);
+        return QueueStatus::kSuccess;
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    DelayQueue(const DelayQueue&) = delete;
+    DelayQueue& operator = (const DelayQueue&) = delete;
+
+private:
+    struct Item {
+        Clock::time_point due;
+        uint64_t seq;
+        Value value;
+    };
+
+    // The earliest item is on the top.
+    struct Later {
+        bool operator () (const Item& a, const Item& b) const {
+            if (a.due != b.due) return a.due > b.due;
+            return a.seq > b.seq;
+        }
+    };
+
+    typedef std::priority_queue<Item, std::vector<Item>, Later> Queue;
+
+    template<class Rep, class Period>
+    static Clock::time_point Deadline(
+            const std::chrono::duration<Rep, Period>& timeout) {
+        using namespace std::chrono;
+        return Clock::now() + duration_cast<Clock::duration>(timeout);
+    }
+
+    template<class Type>
+    bool PushImpl(Type&& val, const Clock::time_point& due) {
+        bool earliest = false;
+        { // Critical region.
+            std::lock_guard<std::mutex> lck(mtx_);
+            if (closed_) return false;
+            queue_.push(Item{due, seq_++, std::forward<Type>(val)});
+            earliest = queue_.top().seq == seq_ - 1;
+        }
+        // Only wake up a consumer when the earliest due time changed.
+        if (earliest) cv_.notify_one();
+        return true;
+    }
+
+    void Take(Value* result) {
+        if (result != NULL) {
+            *result = std::move(QueueAdapter<Queue>::Front(queue_).value);
+        }
+        queue_.pop();
+        // The next element may be due already, let other consumer go on.
+        if (!queue_.empty()) cv_.notify_one();
+    }
+
+private:
+    bool closed_;
+    uint64_t seq_;
+    Queue queue_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+} // namespace iter
+
+#endif // ITER_DELAY_QUEUE_HPP
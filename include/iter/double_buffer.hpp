@@ -1,10 +1,17 @@
 #ifndef ITER_DOUBLE_BUFFER_HPP
 #define ITER_DOUBLE_BUFFER_HPP
 
+#include <iter/reader_slots.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace iter {
 
@@ -12,13 +19,43 @@ namespace iter {
 template<class Buffer>
 class DoubleBuffer{
 public:
+    // The pointer to the active buffer got by Read.
+    typedef GuardedPtr<typename std::add_const<Buffer>::type> ReadPtr;
+    // The mutation of the buffer for UpdateDelta.
+    typedef std::function<void(Buffer*)> Delta;
+
     DoubleBuffer();
 
     // If the reserved buffer is released by all users, return true;
     bool Released();
 
     // Get the const shared pointer of the active buffer.
-    std::shared_ptr<typename std::add_const<Buffer>::type> Get();
+    // The version and the publish time of the buffer are also stored if
+    // the pointers are not NULL.
+    std::shared_ptr<typename std::add_const<Buffer>::type> Get(
+        uint64_t* version = NULL,
+        std::chrono::system_clock::time_point* publish_time = NULL);
+
+    // Get the active buffer without touching the shared reference count,
+    // the reader is registered in the slot of its thread instead. e.g.
+    //     auto ptr = db.Read();
+    //     Lookup(*ptr);
+    // Keep the ReadPtr short-lived, the buffer can not be updated until
+    // it is destroyed. The version and the publish time are same as Get.
+    ReadPtr Read(uint64_t* version = NULL,
+        std::chrono::system_clock::time_point* publish_time = NULL);
+
+    // The version of the active buffer, it increases by one on each update
+    // from 0 of the initial empty buffer. Only an atomic load, e.g. for
+    // the derived caches to check whether to rebuild.
+    uint64_t Version() { return version_.load(); }
+
+    // The time when the active buffer is published.
+    std::chrono::system_clock::time_point PublishTime() {
+        std::chrono::system_clock::time_point publish_time;
+        Read(NULL, &publish_time);
+        return publish_time;
+    }
 
     // You can directly operate the reserved buffer, NO thread-safe guarantee.
     Buffer* GetReservedBuffer();
@@ -31,6 +68,36 @@ public:
     bool Update(Buffer&& buffer);
     bool Update(std::unique_ptr<Buffer>&& buffer_ptr);
 
+    // Same as Update, but wait until the reserved buffer is released by
+    // all users, return false when timeout.
+    template<class Rep, class Period>
+    bool UpdateWait(const std::chrono::duration<Rep, Period>& timeout);
+    template<class Rep, class Period>
+    bool UpdateWait(const Buffer& buffer,
+        const std::chrono::duration<Rep, Period>& timeout);
+    template<class Rep, class Period>
+    bool UpdateWait(Buffer&& buffer,
+        const std::chrono::duration<Rep, Period>& timeout);
+    template<class Rep, class Period>
+    bool UpdateWait(std::unique_ptr<Buffer>&& buffer_ptr,
+        const std::chrono::duration<Rep, Period>& timeout);
+
+    // Apply the delta to the reserved buffer and make it active, return
+    // false if the reserved buffer is not released. The deltas are kept
+    // and replayed onto the next reserved buffer, so each update costs
+    // O(delta) instead of copying the buffer. After the other updates or
+    // GetReservedBuffer, the first delta copies the active buffer into
+    // the reserved one, Buffer MUST be copy assignable then.
+    // The delta MUST be deterministic, it is applied to both buffers.
+    bool UpdateDelta(const Delta& delta);
+    template<class Rep, class Period>
+    bool UpdateDeltaWait(const Delta& delta,
+        const std::chrono::duration<Rep, Period>& timeout);
+
+    // Replace the reserved buffer with an empty one to free it early,
+    // e.g. unmap the old file. Return false if it is not released.
+    bool ClearReserved();
+
     // Disable copy constructor and copy assignment operator.
     DoubleBuffer(const DoubleBuffer&) = delete;
     DoubleBuffer& operator = (const DoubleBuffer&) = delete;
@@ -38,67 +105,282 @@ public:
     DoubleBuffer(DoubleBuffer&&) = default;
     DoubleBuffer& operator = (DoubleBuffer&&) = default;
 
+private:
+    typedef typename std::add_const<Buffer>::type ConstBuffer;
+
+    // The states shared with the pointers got by Get, which may outlive
+    // the double buffer.
+    struct State {
+        // The readers of each buffer.
+        ReaderSlots readers;
+        // Whether any pointer got by Get of each buffer is alive.
+        std::atomic<bool> leased[2];
+
+        State() { leased[0] = false; leased[1] = false; }
+    };
+
+    // Mark the buffer released when the last pointer got by Get is
+    // destroyed, and wake up the waiting updater.
+    struct LeaseDeleter {
+        std::shared_ptr<Buffer> owner;
+        std::shared_ptr<State> state;
+        int idx;
+
+        void operator () (ConstBuffer*) {
+            owner.reset();
+            state->leased[idx].store(false);
+            state->readers.Notify();
+        }
+    };
+
+    bool ReleasedLocked();
+
+    // Wait until the reserved buffer is released or timeout.
+    bool WaitReleased(const std::chrono::steady_clock::duration& timeout);
+
+    // Make the reserved buffer active.
+    void Swap();
+
+    // Bring the released reserved buffer up to date, apply the delta to
+    // it and make it active.
+    void SwapDelta(const Delta& delta);
+
 private:
     // The index of active buffer.
-    int active_idx_;
+    std::atomic<int> active_idx_;
     // The shared pointer of the two buffer.
     std::shared_ptr<Buffer> buffer_ptr_[2];
+    // The pointer of the active buffer copied by Get, it is reset once the
+    // buffer is reserved, then the deleter is called by the last user.
+    std::shared_ptr<ConstBuffer> lease_[2];
+    // The version and the publish time of each buffer, they are changed
+    // only when the buffer is released like the buffer itself.
+    uint64_t buffer_version_[2];
+    std::chrono::system_clock::time_point publish_time_[2];
+    // The version of the active buffer.
+    std::atomic<uint64_t> version_;
+    std::shared_ptr<State> state_;
+    // The deltas applied to the active buffer but not to the reserved one,
+    // it is valid only when delta_synced_ is true.
+    std::vector<Delta> pending_delta_;
+    bool delta_synced_;
     std::mutex mtx_;
 };
 
 template<class Buffer>
-DoubleBuffer<Buffer>::DoubleBuffer() : active_idx_(0) {
+DoubleBuffer<Buffer>::DoubleBuffer() :
+        active_idx_(1), version_(0), state_(new State()), delta_synced_(true) {
     buffer_ptr_[0] = std::make_shared<Buffer>();
     buffer_ptr_[1] = std::make_shared<Buffer>();
+    buffer_version_[1] = 0;
+    Swap();
+    // Both are empty.
+    delta_synced_ = true;
+    buffer_version_[0] = 0;
+    version_.store(0);
 }
 
 template<class Buffer>
 bool DoubleBuffer<Buffer>::Released() {
-    return buffer_ptr_[active_idx_ ^ 1].unique();
+    std::lock_guard<std::mutex> lck(mtx_);
+    return ReleasedLocked();
 }
 
 template<class Buffer>
-std::shared_ptr<typename std::add_const<Buffer>::type> DoubleBuffer<Buffer>::Get() {
-    return buffer_ptr_[active_idx_];
+std::shared_ptr<typename std::add_const<Buffer>::type> DoubleBuffer<Buffer>::Get(
+        uint64_t* version, std::chrono::system_clock::time_point* publish_time) {
+    // Register during the copy, so the lease is not reset by Update at
+    // the same time.
+    int idx = 0;
+    std::atomic<long>* counter = state_->readers.Enter(active_idx_, &idx);
+    std::shared_ptr<ConstBuffer> result = lease_[idx];
+    if (version != NULL) *version = buffer_version_[idx];
+    if (publish_time != NULL) *publish_time = publish_time_[idx];
+    state_->readers.Leave(counter);
+    return result;
+}
+
+template<class Buffer>
+typename DoubleBuffer<Buffer>::ReadPtr DoubleBuffer<Buffer>::Read(
+        uint64_t* version, std::chrono::system_clock::time_point* publish_time) {
+    int idx = 0;
+    std::atomic<long>* counter = state_->readers.Enter(active_idx_, &idx);
+    if (version != NULL) *version = buffer_version_[idx];
+    if (publish_time != NULL) *publish_time = publish_time_[idx];
+    return ReadPtr(&state_->readers, counter, buffer_ptr_[idx].get());
 }
 
 template<class Buffer>
 Buffer* DoubleBuffer<Buffer>::GetReservedBuffer() {
-    return buffer_ptr_[active_idx_ ^ 1].get();
+    // The caller may change it.
+    std::lock_guard<std::mutex> lck(mtx_);
+    delta_synced_ = false;
+    return buffer_ptr_[active_idx_.load() ^ 1].get();
+}
+
+template<class Buffer>
+bool DoubleBuffer<Buffer>::ReleasedLocked() {
+    int idx = active_idx_.load() ^ 1;
+    if (state_->readers.Readers(idx) != 0) return false;
+    // No reader can copy the lease of the reserved buffer now.
+    lease_[idx].reset();
+    return !state_->leased[idx].load();
+}
+
+template<class Buffer>
+bool DoubleBuffer<Buffer>::WaitReleased(
+        const std::chrono::steady_clock::duration& timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    int idx = active_idx_.load() ^ 1;
+    State* state = state_.get();
+    if (!state->readers.WaitUntil(idx, deadline,
+            [state, idx] { return state->readers.Readers(idx) == 0; })) {
+        return false;
+    }
+    // Reset out of the predicate, the deleter may notify.
+    lease_[idx].reset();
+    return state->readers.WaitUntil(deadline,
+        [state, idx] { return !state->leased[idx].load(); });
+}
+
+template<class Buffer>
+void DoubleBuffer<Buffer>::Swap() {
+    int idx = active_idx_.load() ^ 1;
+    state_->leased[idx].store(true);
+    lease_[idx] = std::shared_ptr<ConstBuffer>(buffer_ptr_[idx].get(),
+        LeaseDeleter{buffer_ptr_[idx], state_, idx});
+    buffer_version_[idx] = buffer_version_[idx ^ 1] + 1;
+    publish_time_[idx] = std::chrono::system_clock::now();
+    active_idx_.store(idx);
+    version_.store(buffer_version_[idx]);
+    // Changed by the other updates, the new reserved buffer is stale.
+    delta_synced_ = false;
+}
+
+template<class Buffer>
+void DoubleBuffer<Buffer>::SwapDelta(const Delta& delta) {
+    int idx = active_idx_.load();
+    Buffer* reserved = buffer_ptr_[idx ^ 1].get();
+    if (delta_synced_) {
+        for (auto& pending : pending_delta_) pending(reserved);
+    }
+    else {
+        *reserved = *buffer_ptr_[idx];
+    }
+    delta(reserved);
+    Swap();
+    // The new reserved buffer only misses this delta.
+    pending_delta_.assign(1, delta);
+    delta_synced_ = true;
 }
 
 template<class Buffer>
 bool DoubleBuffer<Buffer>::Update() {
     std::lock_guard<std::mutex> lck(mtx_);
-    if (!Released()) return false;
-    active_idx_ ^= 1;
+    if (!ReleasedLocked()) return false;
+    Swap();
     return true;
 }
 
 template<class Buffer>
 bool DoubleBuffer<Buffer>::Update(const Buffer& buffer) {
     std::lock_guard<std::mutex> lck(mtx_);
-    if (!Released()) return false;
-    *buffer_ptr_[active_idx_ ^ 1] = buffer;
-    active_idx_ ^= 1;
+    if (!ReleasedLocked()) return false;
+    *buffer_ptr_[active_idx_.load() ^ 1] = buffer;
+    Swap();
     return true;
 }
 
 template<class Buffer>
 bool DoubleBuffer<Buffer>::Update(Buffer&& buffer) {
     std::lock_guard<std::mutex> lck(mtx_);
-    if (!Released()) return false;
-    *buffer_ptr_[active_idx_ ^ 1] = std::move(buffer);
-    active_idx_ ^= 1;
+    if (!ReleasedLocked()) return false;
+    *buffer_ptr_[active_idx_.load() ^ 1] = std::move(buffer);
+    Swap();
     return true;
 }
 
 template<class Buffer>
 bool DoubleBuffer<Buffer>::Update(std::unique_ptr<Buffer>&& buffer_ptr) {
     std::lock_guard<std::mutex> lck(mtx_);
-    if (!Released()) return false;
-    buffer_ptr_[active_idx_ ^ 1] = std::move(buffer_ptr);
-    active_idx_ ^= 1;
+    if (!ReleasedLocked()) return false;
+    buffer_ptr_[active_idx_.load() ^ 1] = std::move(buffer_ptr);
+    Swap();
+    return true;
+}
+
+template<class Buffer>
+bool DoubleBuffer<Buffer>::UpdateDelta(const Delta& delta) {
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (!ReleasedLocked()) return false;
+    SwapDelta(delta);
+    return true;
+}
+
+template<class Buffer>
+template<class Rep, class Period>
+bool DoubleBuffer<Buffer>::UpdateDeltaWait(const Delta& delta,
+        const std::chrono::duration<Rep, Period>& timeout) {
+    using namespace std::chrono;
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (!WaitReleased(duration_cast<steady_clock::duration>(timeout))) return false;
+    SwapDelta(delta);
+    return true;
+}
+
+template<class Buffer>
+bool DoubleBuffer<Buffer>::ClearReserved() {
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (!ReleasedLocked()) return false;
+    buffer_ptr_[active_idx_.load() ^ 1] = std::make_shared<Buffer>();
+    delta_synced_ = false;
+    return true;
+}
+
+template<class Buffer>
+template<class Rep, class Period>
+bool DoubleBuffer<Buffer>::UpdateWait(
+        const std::chrono::duration<Rep, Period>& timeout) {
+    using namespace std::chrono;
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (!WaitReleased(duration_cast<steady_clock::duration>(timeout))) return false;
+    Swap();
+    return true;
+}
+
+template<class Buffer>
+template<class Rep, class Period>
+bool DoubleBuffer<Buffer>::UpdateWait(const Buffer& buffer,
+        const std::chrono::duration<Rep, Period>& timeout) {
+    using namespace std::chrono;
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (!WaitReleased(duration_cast<steady_clock::duration>(timeout))) return false;
+    *buffer_ptr_[active_idx_.load() ^ 1] = buffer;
+    Swap();
+    return true;
+}
+
+template<class Buffer>
+template<class Rep, class Period>
+bool DoubleBuffer<Buffer>::UpdateWait(Buffer&& buffer,
+        const std::chrono::duration<Rep, Period>& timeout) {
+    using namespace std::chrono;
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (!WaitReleased(duration_cast<steady_clock::duration>(timeout))) return false;
+    *buffer_ptr_[active_idx_.load() ^ 1] = std::move(buffer);
+    Swap();
+    return true;
+}
+
+template<class Buffer>
+template<class Rep, class Period>
+bool DoubleBuffer<Buffer>::UpdateWait(std::unique_ptr<Buffer>&& buffer_ptr,
+        const std::chrono::duration<Rep, Period>& timeout) {
+    using namespace std::chrono;
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (!WaitReleased(duration_cast<steady_clock::duration>(timeout))) return false;
+    buffer_ptr_[active_idx_.load() ^ 1] = std::move(buffer_ptr);
+    Swap();
     return true;
 }
 
@@ -0,0 +1,148 @@
+#ifndef ITER_EPOCH_BUFFER_HPP
+#define ITER_EPOCH_BUFFER_HPP
+
+#include <iter/reader_slots.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace iter {
+
+// A multi-version buffer whose Update never fails, unlike DoubleBuffer.
+// Update publishes a new version at once, the replaced versions are
+// retired and freed by epoch-based reclamation once the readers which
+// may see them are gone. At most max_versions versions are kept in all,
+// when the limit is reached Update waits for the old readers before
+// publishing, the other writers and Reclaim are not blocked meanwhile.
+// Buffer MUST have no-arguments constructor.
+template<class Buffer>
+class EpochBuffer {
+public:
+    // The pointer to the current version got by Read.
+    typedef GuardedPtr<typename std::add_const<Buffer>::type> ReadPtr;
+
+    // The max_versions is at least 2, the current one and a retired one.
+    explicit EpochBuffer(size_t max_versions = 4);
+
+    // Get the current version, the reader is registered in the slot of
+    // its thread. Keep the ReadPtr short-lived, the versions can not be
+    // freed until it is destroyed.
+    ReadPtr Read();
+
+    // Publish the new version, and retire the current one.
+    // The calling thread MUST NOT hold a ReadPtr, it may wait for itself
+    // forever when the limit is reached.
+    void Update(const Buffer& buffer);
+    void Update(Buffer&& buffer);
+    void Update(std::unique_ptr<Buffer>&& buffer_ptr);
+
+    // Free the retired versions which no reader can see,
+    // return the number of versions alive, including the current one.
+    size_t Reclaim();
+
+    // Disable copy constructor and copy assignment operator.
+    EpochBuffer(const EpochBuffer&) = delete;
+    EpochBuffer& operator = (const EpochBuffer&) = delete;
+
+private:
+    // Advance the epoch when no reader of the last epoch is left,
+    // then free the versions retired two epochs ago.
+    void ReclaimLocked();
+
+private:
+    size_t max_versions_;
+    // The readers enter the current epoch.
+    std::atomic<uint64_t> epoch_;
+    std::atomic<Buffer*> current_;
+    std::unique_ptr<Buffer> current_owner_;
+    // The retired versions with the epoch they are retired in, oldest first.
+    std::deque<std::pair<uint64_t, std::unique_ptr<Buffer>>> retired_;
+    ReaderSlots readers_;
+    std::mutex mtx_;
+};
+
+template<class Buffer>
+EpochBuffer<Buffer>::EpochBuffer(size_t max_versions) :
+        max_versions_(std::max<size_t>(max_versions, 2)), epoch_(0),
+        current_(nullptr), current_owner_(new Buffer()) {
+    current_.store(current_owner_.get());
+}
+
+template<class Buffer>
+typename EpochBuffer<Buffer>::ReadPtr EpochBuffer<Buffer>::Read() {
+    uint64_t epoch = 0;
+    std::atomic<long>* counter = readers_.Enter(epoch_, &epoch);
+    return ReadPtr(&readers_, counter, current_.load());
+}
+
+template<class Buffer>
+void EpochBuffer<Buffer>::Update(const Buffer& buffer) {
+    Update(std::unique_ptr<Buffer>(new Buffer(buffer)));
+}
+
+template<class Buffer>
+void EpochBuffer<Buffer>::Update(Buffer&& buffer) {
+    Update(std::unique_ptr<Buffer>(new Buffer(std::move(buffer))));
+}
+
+template<class Buffer>
+void EpochBuffer<Buffer>::Update(std::unique_ptr<Buffer>&& buffer_ptr) {
+    std::unique_lock<std::mutex> lck(mtx_);
+    ReclaimLocked();
+    // Wait for the room of the version to retire before publishing, so
+    // the concurrent writers never exceed the limit together.
+    while (retired_.size() + 2 > max_versions_) {
+        // The readers of the last epoch keep the epoch from advancing,
+        // wait for them out of the lock.
+        uint64_t epoch = epoch_.load();
+        lck.unlock();
+        readers_.WaitUntil(epoch + 1, std::chrono::steady_clock::time_point::max(),
+            [this, epoch] {
+                return epoch_.load() != epoch || readers_.Readers(epoch + 1) == 0;
+            });
+        lck.lock();
+        ReclaimLocked();
+    }
+    // The readers entering after the store can only see the new version.
+    current_.store(buffer_ptr.get());
+    retired_.emplace_back(epoch_.load(), std::move(current_owner_));
+    current_owner_ = std::move(buffer_ptr);
+    ReclaimLocked();
+}
+
+template<class Buffer>
+size_t EpochBuffer<Buffer>::Reclaim() {
+    std::lock_guard<std::mutex> lck(mtx_);
+    ReclaimLocked();
+    return retired_.size() + 1;
+}
+
+template<class Buffer>
+void EpochBuffer<Buffer>::ReclaimLocked() {
+    // Twice at most, a version retired in epoch e is freed in epoch e + 2.
+    bool advanced = false;
+    for (int i = 0; i < 2 && !retired_.empty(); i++) {
+        uint64_t epoch = epoch_.load();
+        // The readers of the same parity as the next epoch entered the
+        // last epoch.
+        if (readers_.Readers(epoch + 1) != 0) break;
+        epoch_.store(epoch + 1);
+        advanced = true;
+    }
+    // Wake up the writers waiting for the old epoch.
+    if (advanced) readers_.Notify();
+    while (!retired_.empty() && retired_.front().first + 2 <= epoch_.load()) {
+        retired_.pop_front();
+    }
+}
+
+} // namespace iter
+
+#endif // ITER_EPOCH_BUFFER_HPP
@@ -0,0 +1,118 @@
+#ifndef ITER_LEFT_RIGHT_HPP
+#define ITER_LEFT_RIGHT_HPP
+
+#include <iter/reader_slots.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace iter {
+
+// The left-right concurrency control over two instances of a container,
+// for read-mostly containers with frequent small writes, e.g. a map.
+// The readers read the active instance, they never block and never touch
+// a shared reference count. The writers apply each operation to the
+// inactive instance and make it active, the operation is kept in the log
+// and replayed onto the other instance on the next write, once its
+// readers are gone. So each write costs the operation twice instead of
+// copying the container like DoubleBuffer. e.g.
+//     LeftRight<std::map<int, int>> lr;
+//     lr.Write([](std::map<int, int>* m) { (*m)[1] = 2; });
+//     auto ptr = lr.Read();
+//     auto iter = ptr->find(1);
+// The operation MUST be deterministic, it is applied to both instances.
+template<class Container,
+        class Operation = std::function<void(Container*)>>
+class LeftRight {
+public:
+    typedef Operation OperationType;
+    typedef GuardedPtr<typename std::add_const<Container>::type> ReadPtr;
+
+    LeftRight() : active_idx_(0) {}
+
+    explicit LeftRight(const Container& container) : active_idx_(0) {
+        instance_[0] = container;
+        instance_[1] = container;
+    }
+
+    // Get the active instance, keep the ReadPtr short-lived, the writers
+    // wait for it on the next write.
+    ReadPtr Read() {
+        int idx = 0;
+        std::atomic<long>* counter = readers_.Enter(active_idx_, &idx);
+        return ReadPtr(&readers_, counter, &instance_[idx]);
+    }
+
+    // Call func(const Container&) on the active instance and return its result.
+    template<class Func>
+    auto Read(Func&& func) -> decltype(func(std::declval<const Container&>())) {
+        ReadPtr ptr = Read();
+        return func(*ptr);
+    }
+
+    // Apply the operation and publish it to the readers.
+    void Write(const Operation& op) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        int idx = Catchup();
+        op(&instance_[idx]);
+        active_idx_.store(idx);
+        oplog_.push_back(op);
+    }
+
+    // Apply the operations and publish them together.
+    void Write(const std::vector<Operation>& op_list) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        int idx = Catchup();
+        for (auto& op : op_list) op(&instance_[idx]);
+        active_idx_.store(idx);
+        oplog_ = op_list;
+    }
+
+    // Replay the logged operations onto the inactive instance now, e.g.
+    // to release the resources held by the operations. It waits for the
+    // readers of the inactive instance.
+    void Flush() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        Catchup();
+    }
+
+    // The number of operations not applied to the inactive instance.
+    size_t Pending() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return oplog_.size();
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    LeftRight(const LeftRight&) = delete;
+    LeftRight& operator = (const LeftRight&) = delete;
+
+private:
+    // Wait for the readers of the inactive instance, and replay the log
+    // onto it. Return the index of the inactive instance.
+    int Catchup() {
+        int idx = active_idx_.load() ^ 1;
+        readers_.WaitUntil(idx, std::chrono::steady_clock::time_point::max(),
+            [this, idx] { return readers_.Readers(idx) == 0; });
+        for (auto& op : oplog_) op(&instance_[idx]);
+        oplog_.clear();
+        return idx;
+    }
+
+private:
+    // The index of the active instance.
+    std::atomic<int> active_idx_;
+    Container instance_[2];
+    // The operations applied to the active instance only.
+    std::vector<Operation> oplog_;
+    ReaderSlots readers_;
+    std::mutex mtx_;
+};
+
+} // namespace iter
+
+#endif // ITER_LEFT_RIGHT_HPP
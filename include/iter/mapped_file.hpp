@@ -0,0 +1,120 @@
+#ifndef ITER_MAPPED_FILE_HPP
+#define ITER_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace iter {
+
+// A read-only memory mapping of a prebuilt binary file, e.g. a lookup
+// table. It is movable but not copyable, and unmapped when destroyed.
+// Use it as the buffer of DoubleBuffer to swap the tables without
+// parsing or copying them onto the heap. e.g.
+//     DoubleBuffer<MappedFile> db;
+//     std::unique_ptr<MappedFile> file(new MappedFile());
+//     if (file->Open("table.bin")) db.UpdateWait(std::move(file), timeout);
+//     auto ptr = db.Read();
+//     const Entry* entry = ptr->As<Entry>(offset);
+// The file MUST be replaced by rename rather than rewritten in place,
+// the mapped pages change with the file.
+class MappedFile {
+public:
+    MappedFile() : data_(NULL), size_(0) {}
+
+    ~MappedFile() { Close(); }
+
+    MappedFile(MappedFile&& other) :
+            path_(std::move(other.path_)), data_(other.data_), size_(other.size_) {
+        other.data_ = NULL;
+        other.size_ = 0;
+    }
+
+    MappedFile& operator = (MappedFile&& other) {
+        if (this != &other) {
+            Close();
+            path_ = std::move(other.path_);
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+        }
+        return *this;
+    }
+
+    // Map the whole file, the mapped one is closed first.
+    // Prefault the pages with MAP_POPULATE when populate is true, so the
+    // first lookups after swapping do not fault. The advice is passed to
+    // madvise, e.g. MADV_RANDOM for hash tables.
+    // Return false when the file can not be mapped.
+    bool Open(const std::string& path, bool populate = true,
+        int advice = MADV_WILLNEED);
+
+    // Unmap the file.
+    void Close();
+
+    const std::string& Path() const { return path_; }
+    const char* Data() const { return static_cast<const char*>(data_); }
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+    // Get the object at the offset, return NULL when it is out of range.
+    // The object is read in place, so it MUST be trivially copyable.
+    template<class Type>
+    const Type* As(size_t offset = 0) const {
+        static_assert(std::is_trivially_copyable<Type>::value,
+            "Type of MappedFile::As must be trivially copyable.");
+        if (offset > size_ || size_ - offset < sizeof(Type)) return NULL;
+        return reinterpret_cast<const Type*>(Data() + offset);
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+private:
+    std::string path_;
+    void* data_;
+    size_t size_;
+};
+
+inline bool MappedFile::Open(const std::string& path, bool populate, int advice) {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void* data = NULL;
+    // The empty file can not be mapped, keep it empty.
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ,
+            MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+    }
+    // The mapping is kept after the file is closed.
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    if (data != NULL) madvise(data, size, advice);
+    path_ = path;
+    data_ = data;
+    size_ = size;
+    return true;
+}
+
+inline void MappedFile::Close() {
+    if (data_ != NULL) munmap(data_, size_);
+    path_.clear();
+    data_ = NULL;
+    size_ = 0;
+}
+
+} // namespace iter
+
+#endif // ITER_MAPPED_FILE_HPP
@@ -0,0 +1,136 @@
+#ifndef ITER_POOLED_QUEUE_HPP
+#define ITER_POOLED_QUEUE_HPP
+
+#include <iter/safe_queue.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace iter {
+
+// A FIFO container with the same interface as std::queue, the nodes are
+// allocated in chunks and recycled through a free list, so the steady
+// state push and pop do not allocate any memory.
+template<class Value, size_t ChunkSize = 64>
+class PooledQueue {
+public:
+    typedef Value value_type;
+    typedef Value& reference;
+    typedef const Value& const_reference;
+    typedef size_t size_type;
+
+    PooledQueue() :
+        head_(NULL), tail_(NULL), free_(NULL), size_(0), alloc_count_(0) {}
+
+    ~PooledQueue() {
+        while (!empty()) pop();
+    }
+
+    size_type size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    reference front() { return *head_->Get(); }
+    const_reference front() const { return *head_->Get(); }
+
+    reference back() { return *tail_->Get(); }
+    const_reference back() const { return *tail_->Get(); }
+
+    void push(const Value& val) { emplace(val); }
+    void push(Value&& val) { emplace(std::move(val)); }
+
+    template<class ...Args>
+    void emplace(Args&& ...args) {
+        Node* node = Acquire();
+        try {
+            new (node->storage) Value(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            // Keep the node in the pool if the constructor throws.
+            Release(node);
+            throw;
+        }
+        node->next = NULL;
+        if (tail_ == NULL) head_ = node;
+        else tail_->next = node;
+        tail_ = node;
+        size_++;
+    }
+
+    void pop() {
+        Node* node = head_;
+        head_ = node->next;
+        if (head_ == NULL) tail_ = NULL;
+        node->Get()->~Value();
+        Release(node);
+        size_--;
+    }
+
+    // Make sure there are at least n nodes without allocation.
+    void reserve(size_type n) {
+        while (capacity() < n) Allocate();
+    }
+
+    // The total number of nodes, including the ones in use.
+    size_type capacity() const { return chunk_list_.size() * ChunkSize; }
+
+    // The number of chunks allocated since constructed.
+    uint64_t alloc_count() const { return alloc_count_; }
+
+    // Disable copy constructor and copy assignment operator.
+    PooledQueue(const PooledQueue&) = delete;
+    PooledQueue& operator = (const PooledQueue&) = delete;
+
+private:
+    struct Node {
+        Node* next;
+        typename std::aligned_storage<
+            sizeof(Value), std::alignment_of<Value>::value>::type storage[1];
+
+        Value* Get() { return reinterpret_cast<Value*>(storage); }
+    };
+
+    Node* Acquire() {
+        if (free_ == NULL) Allocate();
+        Node* node = free_;
+        free_ = node->next;
+        return node;
+    }
+
+    void Release(Node* node) {
+        node->next = free_;
+        free_ = node;
+    }
+
+    void Allocate() {
+        std::unique_ptr<Node[]> chunk(new Node[ChunkSize]);
+        // Own the chunk before linking its nodes, push_back may throw.
+        chunk_list_.push_back(std::move(chunk));
+        Node* nodes = chunk_list_.back().get();
+        for (size_t i = 0; i < ChunkSize; i++) Release(&nodes[i]);
+        alloc_count_++;
+    }
+
+private:
+    Node* head_;
+    Node* tail_;
+    // The free list of the recycled nodes.
+    Node* free_;
+    size_type size_;
+    uint64_t alloc_count_;
+    std::vector<std::unique_ptr<Node[]>> chunk_list_;
+};
+
+// SafeQueue without per-element allocation, the counters can be read
+// through SafeQueue::Inspect. NOTICE: PopAll starts a new pool.
+template<class Value, size_t ChunkSize = 64>
+using PooledSafeQueue = SafeQueue<Value, PooledQueue<Value, ChunkSize>>;
+
+} // namespace iter
+
+#endif // ITER_POOLED_QUEUE_HPP
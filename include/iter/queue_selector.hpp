@@ -0,0 +1,106 @@
+#ifndef ITER_QUEUE_SELECTOR_HPP
+#define ITER_QUEUE_SELECTOR_HPP
+
+#include <iter/safe_queue.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace iter {
+
+// Block on several queues at once and return the first one with data,
+// the queues can have different value types. e.g.
+//     QueueSelector selector;
+//     selector.Add(&int_queue);     // Index 0.
+//     selector.Add(&string_queue);  // Index 1.
+//     int index = selector.Select();
+// The queues MUST outlive the selector. Another consumer may fetch the
+// element before the caller, so Pop the selected queue instead of Get.
+class QueueSelector {
+public:
+    QueueSelector() : notifier_(std::make_shared<QueueNotifier>()), cursor_(0) {}
+
+    ~QueueSelector() {
+        for (auto& remove : remove_list_) remove();
+    }
+
+    // Return the index of the queue, in the order of adding.
+    template<class Queue>
+    int Add(Queue* queue);
+
+    int Size() { return ready_list_.size(); }
+
+    // Block until one of the queues is not empty, return its index.
+    // Return -1 when all the queues are closed and drained.
+    int Select() {
+        int index = -1;
+        SelectUntil(&index, std::chrono::steady_clock::time_point::max());
+        return index;
+    }
+
+    // Select with timeout.
+    template<class Rep, class Period>
+    QueueStatus SelectFor(int* index,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        using namespace std::chrono;
+        return SelectUntil(index,
+            steady_clock::now() + duration_cast<steady_clock::duration>(timeout));
+    }
+
+    QueueStatus SelectUntil(int* index,
+            const std::chrono::steady_clock::time_point& deadline);
+
+    // Disable copy constructor and copy assignment operator.
+    QueueSelector(const QueueSelector&) = delete;
+    QueueSelector& operator = (const QueueSelector&) = delete;
+
+private:
+    enum class State { kReady, kEmpty, kClosed };
+
+    std::shared_ptr<QueueNotifier> notifier_;
+    std::vector<std::function<State()>> ready_list_;
+    std::vector<std::function<void()>> remove_list_;
+    // Start from the next queue of the last selected one, to be fair.
+    size_t cursor_;
+};
+
+template<class Queue>
+int QueueSelector::Add(Queue* queue) {
+    queue->AddNotifier(notifier_);
+    ready_list_.push_back([queue]() -> State {
+        if (!queue->Empty()) return State::kReady;
+        // Check again, it may be pushed before closed.
+        if (queue->IsClosed()) return queue->Empty() ? State::kClosed : State::kReady;
+        return State::kEmpty;
+    });
+    std::shared_ptr<QueueNotifier> notifier = notifier_;
+    remove_list_.push_back([queue, notifier] { queue->RemoveNotifier(notifier); });
+    return ready_list_.size() - 1;
+}
+
+inline QueueStatus QueueSelector::SelectUntil(int* index,
+        const std::chrono::steady_clock::time_point& deadline) {
+    while (true) {
+        // Any push after reading the sequence will change it.
+        uint64_t seq = notifier_->Seq();
+        size_t closed = 0;
+        for (size_t i = 0; i < ready_list_.size(); i++) {
+            size_t cur = (cursor_ + i) % ready_list_.size();
+            State state = ready_list_[cur]();
+            if (state == State::kReady) {
+                cursor_ = cur + 1;
+                if (index != NULL) *index = cur;
+                return QueueStatus::kSuccess;
+            }
+            if (state == State::kClosed) closed++;
+        }
+        if (closed == ready_list_.size()) return QueueStatus::kClosed;
+        if (!notifier_->WaitUntil(seq, deadline)) return QueueStatus::kTimeout;
+    }
+}
+
+} // namespace iter
+
+#endif // ITER_QUEUE_SELECTOR_HPP
@@ -0,0 +1,190 @@
+#ifndef ITER_READER_SLOTS_HPP
+#define ITER_READER_SLOTS_HPP
+
+#include <iter/thread_index.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+namespace iter {
+
+// Count the readers of a phase, the phase is the index of a buffer or an
+// epoch, only its parity is counted. The threads share the slots by the
+// thread index, so readers of different threads seldom touch the same
+// cache line. The writer can wait for the readers to leave, only the
+// last reader of a slot of the awaited parity wakes it up, the others
+// never touch the lock.
+class ReaderSlots {
+public:
+    ReaderSlots() : waiters_(0) {
+        draining_[0] = 0;
+        draining_[1] = 0;
+    }
+
+    // Register the calling thread as a reader of the current phase,
+    // the phase is stored into *result.
+    // Return the counter to decrease when the reader leaves.
+    template<class Phase>
+    std::atomic<long>* Enter(const std::atomic<Phase>& phase, Phase* result) {
+        unsigned index = ThisThreadIndex() % kSlots;
+        while (true) {
+            Phase cur = phase.load();
+            std::atomic<long>* counter = &slot_[cur & 1][index].count;
+            counter->fetch_add(1);
+            // The phase may be changed before the registration is seen by
+            // the writer, check it again.
+            if (phase.load() == cur) {
+                *result = cur;
+                return counter;
+            }
+            Leave(counter);
+        }
+    }
+
+    // Leave with the counter returned by Enter.
+    void Leave(std::atomic<long>* counter) {
+        // The parity is drained only after the counter of a slot is 0.
+        if (counter->fetch_sub(1) != 1) return;
+        if (draining_[Parity(counter)].load() == 0) return;
+        std::lock_guard<std::mutex> lck(mtx_);
+        cv_.notify_all();
+    }
+
+    // Wake up the waiters to check their conditions again, call it after
+    // changing the states they wait for.
+    void Notify() {
+        if (waiters_.load() == 0) return;
+        std::lock_guard<std::mutex> lck(mtx_);
+        cv_.notify_all();
+    }
+
+    // Wait until the predicate is true or the deadline, return the
+    // predicate. It is woken up by Notify only.
+    // The deadline of time_point::max() means no timeout.
+    template<class Predicate>
+    bool WaitUntil(const std::chrono::steady_clock::time_point& deadline,
+            Predicate pred) {
+        waiters_++;
+        bool ret = Wait(deadline, pred);
+        waiters_--;
+        return ret;
+    }
+
+    // Same as above, and woken up when the readers of the parity leave,
+    // the predicate usually waits for Readers(parity) == 0.
+    template<class Predicate>
+    bool WaitUntil(unsigned parity,
+            const std::chrono::steady_clock::time_point& deadline, Predicate pred) {
+        waiters_++;
+        draining_[parity & 1]++;
+        bool ret = Wait(deadline, pred);
+        draining_[parity & 1]--;
+        waiters_--;
+        return ret;
+    }
+
+    // The number of registered readers of the phases with the parity.
+    long Readers(unsigned parity) {
+        long readers = 0;
+        for (auto& slot : slot_[parity & 1]) readers += slot.count.load();
+        return readers;
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    ReaderSlots(const ReaderSlots&) = delete;
+    ReaderSlots& operator = (const ReaderSlots&) = delete;
+
+private:
+    static const unsigned kSlots = 64;
+
+    struct Slot {
+        std::atomic<long> count;
+        // Keep the slots from sharing cache line.
+        char padding[64];
+
+        Slot() : count(0) {}
+    };
+
+    unsigned Parity(const std::atomic<long>* counter) {
+        return counter >= &slot_[1][0].count ? 1 : 0;
+    }
+
+    template<class Predicate>
+    bool Wait(const std::chrono::steady_clock::time_point& deadline,
+            Predicate pred) {
+        std::unique_lock<std::mutex> lck(mtx_);
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            cv_.wait(lck, pred);
+            return true;
+        }
+        return cv_.wait_until(lck, deadline, pred);
+    }
+
+    // The slots of the even phases and the odd phases.
+    Slot slot_[2][kSlots];
+    // The number of writers waiting.
+    std::atomic<int> waiters_;
+    // The number of writers waiting for the readers of each parity.
+    std::atomic<int> draining_[2];
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+// The pointer got from a reader registered in ReaderSlots, the reader
+// leaves when it is destroyed or reset. It is movable but not copyable.
+template<class Type>
+class GuardedPtr {
+public:
+    GuardedPtr() : slots_(nullptr), counter_(nullptr), ptr_(nullptr) {}
+
+    GuardedPtr(ReaderSlots* slots, std::atomic<long>* counter, Type* ptr) :
+        slots_(slots), counter_(counter), ptr_(ptr) {}
+
+    GuardedPtr(GuardedPtr&& other) :
+            slots_(other.slots_), counter_(other.counter_), ptr_(other.ptr_) {
+        other.slots_ = nullptr;
+        other.counter_ = nullptr;
+        other.ptr_ = nullptr;
+    }
+
+    GuardedPtr& operator = (GuardedPtr&& other) {
+        if (this != &other) {
+            Reset();
+            std::swap(slots_, other.slots_);
+            std::swap(counter_, other.counter_);
+            std::swap(ptr_, other.ptr_);
+        }
+        return *this;
+    }
+
+    ~GuardedPtr() { Reset(); }
+
+    // Leave the reader slot.
+    void Reset() {
+        if (counter_ != nullptr) slots_->Leave(counter_);
+        slots_ = nullptr;
+        counter_ = nullptr;
+        ptr_ = nullptr;
+    }
+
+    Type* get() const { return ptr_; }
+    Type& operator * () const { return *ptr_; }
+    Type* operator -> () const { return ptr_; }
+    explicit operator bool () const { return ptr_ != nullptr; }
+
+    // Disable copy constructor and copy assignment operator.
+    GuardedPtr(const GuardedPtr&) = delete;
+    GuardedPtr& operator = (const GuardedPtr&) = delete;
+
+private:
+    ReaderSlots* slots_;
+    std::atomic<long>* counter_;
+    Type* ptr_;
+};
+
+} // namespace iter
+
+#endif // ITER_READER_SLOTS_HPP
@@ -2,7 +2,10 @@
 #define ITER_REGISTRY_HPP
 
 #include <mutex>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 
 namespace iter {
 
@@ -11,9 +14,67 @@ template<class Node, class Handle = int,
         class Map = std::unordered_map<Handle, Node>>
 class Registry {
 public:
+    // The pointer to a node holding the lock of the registry, the node
+    // can not be removed while it is held. Keep it short-lived, the other
+    // calls on the registry block until it is reset, including the ones
+    // from the same thread.
+    class NodePtr {
+    public:
+        NodePtr() : ptr_(nullptr) {}
+
+        NodePtr(std::unique_lock<std::mutex>&& lck, Node* ptr) :
+            lck_(std::move(lck)), ptr_(ptr) {}
+
+        NodePtr(NodePtr&& other) : lck_(std::move(other.lck_)), ptr_(other.ptr_) {
+            other.ptr_ = nullptr;
+        }
+
+        NodePtr& operator = (NodePtr&& other) {
+            if (this != &other) {
+                Reset();
+                lck_ = std::move(other.lck_);
+                ptr_ = other.ptr_;
+                other.ptr_ = nullptr;
+            }
+            return *this;
+        }
+
+        // Release the lock.
+        void Reset() {
+            if (lck_.owns_lock()) lck_.unlock();
+            ptr_ = nullptr;
+        }
+
+        Node* get() const { return ptr_; }
+        Node& operator * () const { return *ptr_; }
+        Node* operator -> () const { return ptr_; }
+        explicit operator bool () const { return ptr_ != nullptr; }
+
+        // Disable copy constructor and copy assignment operator.
+        NodePtr(const NodePtr&) = delete;
+        NodePtr& operator = (const NodePtr&) = delete;
+
+    private:
+        std::unique_lock<std::mutex> lck_;
+        Node* ptr_;
+    };
+
+    Registry() : register_handle_counter_() {}
+
     // Return the handle of this node.
     Handle Register(const Node& node);
     Handle Register(Node&& node);
+
+    // Construct the node in place with the arguments, e.g.
+    //     Registry<std::pair<int, std::string>> registry;
+    //     registry.Register(1, "girigiri");
+    // The single argument of type Node goes to the ones above.
+    template<class... Args, class = typename std::enable_if<
+            !(sizeof...(Args) == 1 && std::is_same<
+                typename std::decay<typename std::tuple_element<0,
+                    std::tuple<Args..., void>>::type>::type, Node>::value)>::type>
+    Handle Register(Args&&... args);
+
     void Remove(Handle handle);
 
     // Check whether it is registered.
@@ -22,6 +83,16 @@ public:
     // Get the node corresponding to the handle.
     Node Get(Handle handle);
 
+    // Get the pointer to the node without copying it, the registry stays
+    // locked until the NodePtr is reset or destroyed.
+    // Return a null NodePtr if it is not registered.
+    NodePtr Find(Handle handle);
+
+    // Call func(Node&) on the node under the lock.
+    // Return false if it is not registered.
+    template<class Func>
+    bool Visit(Handle handle, Func&& func);
+
 protected:
     Map register_map_;
     Handle register_handle_counter_;
@@ -44,6 +115,17 @@ Handle Registry<Node, Handle, Map>::Register(Node&& node) {
     return register_handle_counter_;
 }
 
+template<class Node, class Handle, class Map>
+template<class... Args, class>
+Handle Registry<Node, Handle, Map>::Register(Args&&... args) {
+    std::lock_guard<std::mutex> lck(mtx_);
+    register_handle_counter_ ++;
+    register_map_.emplace(std::piecewise_construct,
+        std::forward_as_tuple(register_handle_counter_),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+    return register_handle_counter_;
+}
+
 template<class Node, class Handle, class Map>
 void Registry<Node, Handle, Map>::Remove(Handle handle) {
     std::lock_guard<std::mutex> lck(mtx_);
@@ -52,14 +134,34 @@ void Registry<Node, Handle, Map>::Remove(Handle handle) {
 
 template<class Node, class Handle, class Map>
 bool Registry<Node, Handle, Map>::IsRegistered(Handle handle) {
+    std::lock_guard<std::mutex> lck(mtx_);
     return register_map_.find(handle) != register_map_.end();
 }
 
 template<class Node, class Handle, class Map>
 Node Registry<Node, Handle, Map>::Get(Handle handle) {
+    std::lock_guard<std::mutex> lck(mtx_);
     return register_map_.at(handle);
 }
 
+template<class Node, class Handle, class Map>
+typename Registry<Node, Handle, Map>::NodePtr Registry<Node, Handle, Map>::Find(Handle handle) {
+    std::unique_lock<std::mutex> lck(mtx_);
+    auto iter = register_map_.find(handle);
+    if (iter == register_map_.end()) return NodePtr();
+    return NodePtr(std::move(lck), &iter->second);
+}
+
+template<class Node, class Handle, class Map>
+template<class Func>
+bool Registry<Node, Handle, Map>::Visit(Handle handle, Func&& func) {
+    std::lock_guard<std::mutex> lck(mtx_);
+    auto iter = register_map_.find(handle);
+    if (iter == register_map_.end()) return false;
+    func(iter->second);
+    return true;
+}
+
 } // namespace iter
 
 #endif // ITER_REGISTRY_HPP
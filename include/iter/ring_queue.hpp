@@ -0,0 +1,170 @@
+#ifndef ITER_RING_QUEUE_HPP
+#define ITER_RING_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace iter {
+
+// A fixed size ring which overwrites the oldest elements when it is full,
+// e.g. for metrics and trace events. Push never blocks on consumers and
+// never allocates, the overwritten elements are counted as dropped.
+// Value MUST be trivially copyable.
+template<class Value>
+class RingQueue {
+    static_assert(std::is_trivially_copyable<Value>::value,
+        "Value of RingQueue must be trivially copyable.");
+
+public:
+    typedef Value ValueType;
+
+    // The capacity will be rounded up to the power of 2.
+    explicit RingQueue(size_t capacity);
+
+    size_t Capacity() { return mask_ + 1; }
+
+    // The number of elements not fetched yet, including the ones which
+    // will be found overwritten.
+    size_t Size();
+
+    bool Empty() { return Size() == 0; }
+
+    // The number of elements overwritten before being fetched.
+    uint64_t Dropped() { return dropped_.load(std::memory_order_relaxed); }
+
+    // Overwrite the oldest element when the ring is full. It never waits
+    // for the consumers, but when the ring wraps around during one write,
+    // it waits for the producer of the same slot one round earlier. So a
+    // producer preempted in the middle of a write may hold up the one
+    // lapping it, make the capacity larger than the elements pushed
+    // during a time slice to avoid it.
+    void Push(const Value& val);
+
+    // Get the oldest element which is not overwritten and pop it.
+    // Return false when there is no element ready.
+    bool Pop(Value* result);
+
+    // Disable copy constructor and copy assignment operator.
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator = (const RingQueue&) = delete;
+
+private:
+    static const size_t kWords = (sizeof(Value) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // The sequence of a slot is 2 * pos + 1 when the element at position
+    // pos is being written, and 2 * pos + 2 when it is written.
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        // The value is kept in atomic words like Snapshot, so the racing
+        // reads of the overwritten elements are defined.
+        std::atomic<uint64_t> word[kWords];
+    };
+
+private:
+    size_t mask_;
+    std::unique_ptr<Slot[]> slot_list_;
+    // Keep the producer and consumer positions from sharing cache line.
+    char padding0_[64];
+    std::atomic<uint64_t> head_;
+    char padding1_[64];
+    std::atomic<uint64_t> tail_;
+    std::atomic<uint64_t> dropped_;
+    std::mutex consumer_mtx_;
+};
+
+template<class Value>
+RingQueue<Value>::RingQueue(size_t capacity) :
+        mask_(1), head_(0), tail_(0), dropped_(0) {
+    while (mask_ < capacity) mask_ <<= 1;
+    mask_--;
+    slot_list_.reset(new Slot[mask_ + 1]);
+    for (size_t i = 0; i <= mask_; i++) {
+        slot_list_[i].seq = 0;
+        for (size_t j = 0; j < kWords; j++) slot_list_[i].word[j] = 0;
+    }
+}
+
+template<class Value>
+size_t RingQueue<Value>::Size() {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (head <= tail) return 0;
+    return std::min<uint64_t>(head - tail, mask_ + 1);
+}
+
+template<class Value>
+void RingQueue<Value>::Push(const Value& val) {
+    uint64_t pos = head_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slot_list_[pos & mask_];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    while (true) {
+        // A newer element is already there, ours is overwritten.
+        if (seq > 2 * pos + 1) return;
+        // A producer of the older round is still writing, it only happens
+        // when the ring is wrapped around during one write.
+        if (seq & 1) {
+            std::this_thread::yield();
+            seq = slot.seq.load(std::memory_order_acquire);
+            continue;
+        }
+        if (slot.seq.compare_exchange_weak(seq, 2 * pos + 1,
+                std::memory_order_acquire, std::memory_order_acquire)) {
+            break;
+        }
+    }
+    uint64_t buffer[kWords] = {0};
+    memcpy(buffer, &val, sizeof(Value));
+    // Order the odd sequence before the stores of the words.
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; i++) {
+        slot.word[i].store(buffer[i], std::memory_order_relaxed);
+    }
+    slot.seq.store(2 * pos + 2, std::memory_order_release);
+}
+
+template<class Value>
+bool RingQueue<Value>::Pop(Value* result) {
+    std::lock_guard<std::mutex> lck(consumer_mtx_);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        if (tail >= head) break;
+        // Skip the elements overwritten already.
+        if (head - tail > mask_ + 1) {
+            dropped_.fetch_add(head - tail - mask_ - 1, std::memory_order_relaxed);
+            tail = head - mask_ - 1;
+        }
+        Slot& slot = slot_list_[tail & mask_];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        // The producer has not finished writing yet.
+        if (seq < 2 * tail + 2) break;
+        if (seq == 2 * tail + 2) {
+            uint64_t buffer[kWords];
+            for (size_t i = 0; i < kWords; i++) {
+                buffer[i] = slot.word[i].load(std::memory_order_relaxed);
+            }
+            // Order the loads of the words before checking the sequence again.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Check whether it is overwritten while copying.
+            if (slot.seq.load(std::memory_order_relaxed) == seq) {
+                if (result != NULL) memcpy(result, buffer, sizeof(Value));
+                tail_.store(tail + 1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        tail++;
+    }
+    tail_.store(tail, std::memory_order_relaxed);
+    return false;
+}
+
+} // namespace iter
+
+#endif // ITER_RING_QUEUE_HPP
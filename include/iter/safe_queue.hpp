@@ -1,47 +1,209 @@
 #ifndef ITER_SAFE_QUEUE_HPP
 #define ITER_SAFE_QUEUE_HPP
 
+#include <algorithm>
 #include <chrono>
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <queue>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif // __linux__
 
 namespace iter {
 
+// Result of the timed operations on the queue.
+enum class QueueStatus {
+    kSuccess,   // An element is fetched.
+    kTimeout,   // The queue is still empty when timeout.
+    kClosed,    // The queue is closed and drained.
+};
+
+// Access the next element of the container used by SafeQueue.
+// Specialize it for the containers which do not provide front().
+template<class Queue>
+struct QueueAdapter {
+    // Whether the elements are fetched in the order of push.
+    static const bool kFifo = true;
+
+    static typename Queue::reference Front(Queue& queue) {
+        return queue.front();
+    }
+};
+
+template<class Value, class Container, class Compare>
+struct QueueAdapter<std::priority_queue<Value, Container, Compare>> {
+    static const bool kFifo = false;
+
+    // The element is only moved out right before pop,
+    // so it is safe to cast away the const of top().
+    static Value& Front(std::priority_queue<Value, Container, Compare>& queue) {
+        return const_cast<Value&>(queue.top());
+    }
+};
+
+// Notified when any of the queues it is added to is pushed or closed,
+// so one consumer can wait on several queues, see QueueSelector.
+class QueueNotifier {
+public:
+    QueueNotifier() : seq_(0) {}
+
+    void Notify() {
+        { // Critical region.
+            std::lock_guard<std::mutex> lck(mtx_);
+            seq_++;
+        }
+        cv_.notify_all();
+    }
+
+    // The sequence is increased on every notification.
+    uint64_t Seq() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return seq_;
+    }
+
+    // Wait until notified after the sequence.
+    // Return false when it is timeout.
+    bool WaitUntil(uint64_t seq,
+            const std::chrono::steady_clock::time_point& deadline) {
+        std::unique_lock<std::mutex> lck(mtx_);
+        auto pred = [this, seq] { return seq_ != seq; };
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            cv_.wait(lck, pred);
+            return true;
+        }
+        return cv_.wait_until(lck, deadline, pred);
+    }
+
+private:
+    uint64_t seq_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+// Statistics of SafeQueue since enabled or reset.
+struct SafeQueueStats {
+    uint64_t push_count;
+    uint64_t pop_count;
+    // Per second.
+    double push_rate;
+    double pop_rate;
+    // The times and the total nanoseconds of waiting for the lock.
+    uint64_t lock_contended;
+    uint64_t lock_wait_ns;
+    size_t max_depth;
+    // Percentiles of the time in queue in microseconds, the upper bound of
+    // the power of 2 bucket. Only available for FIFO queue.
+    double time_in_queue_p50_us;
+    double time_in_queue_p90_us;
+    double time_in_queue_p99_us;
+};
+
 template<class Value, class Queue = std::queue<Value>>
 class SafeQueue {
 public:
     typedef Value ValueType;
     typedef Queue QueueType;
 
-    SafeQueue() : shutdown_(false), queue_ptr_(new Queue()) {}
+    SafeQueue() :
+        closed_(false), queue_ptr_(new Queue()), event_fd_(-1), waiters_(0),
+        size_(0), stats_enabled_(false), stats_() {}
 
     ~SafeQueue() {
+        Close();
+#ifdef __linux__
+        if (event_fd_ >= 0) ::close(event_fd_);
+#endif // __linux__
+    }
+
+public:
+    // Lock-free, the size may be changed right after it returns.
+    decltype(std::declval<Queue>().size()) Size() {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    bool Empty() { return Size() == 0; }
+
+    // Close the queue, it is the end-of-stream signal of producers.
+    // The elements already in the queue can still be fetched, all the
+    // blocked consumers will be woken up once the queue is drained.
+    void Close() {
         { // Critical region.
             std::lock_guard<std::mutex> lck(mtx_);
-            shutdown_ = true;
+            closed_ = true;
+            // Selectors and event loops need to see it is closed.
+            for (auto& notifier : notifier_list_) notifier->Notify();
+            SetEvent(true);
         }
         cv_.notify_all();
     }
 
-public:
-    decltype(std::declval<Queue>().size()) Size() { return queue_ptr_->size(); }
-
-    bool Empty() { return queue_ptr_->empty(); }
-
-    void Push(const Value& val) {
+    bool IsClosed() {
         std::lock_guard<std::mutex> lck(mtx_);
+        return closed_;
+    }
+
+    // Return false when the queue is closed, the value is discarded.
+    bool Push(const Value& val) {
+        std::unique_lock<std::mutex> lck = Lock();
+        if (closed_) return false;
+        bool was_empty = queue_ptr_->empty();
         queue_ptr_->push(val);
-        cv_.notify_one();
+        AfterPush(was_empty);
+        // Only notify when someone is waiting, and after unlock, so the
+        // woken consumer does not block on the mutex again.
+        bool notify = waiters_ > 0;
+        lck.unlock();
+        if (notify) cv_.notify_one();
+        return true;
     }
 
-    void Push(Value&& val) {
-        std::lock_guard<std::mutex> lck(mtx_);
+    bool Push(Value&& val) {
+        std::unique_lock<std::mutex> lck = Lock();
+        if (closed_) return false;
+        bool was_empty = queue_ptr_->empty();
         queue_ptr_->push(std::move(val));
-        cv_.notify_one();
+        AfterPush(was_empty);
+        // Only notify when someone is waiting, and after unlock, so the
+        // woken consumer does not block on the mutex again.
+        bool notify = waiters_ > 0;
+        lck.unlock();
+        if (notify) cv_.notify_one();
+        return true;
+    }
+
+    // Push the elements in the range with one lock, and wake up at most
+    // as many consumers as the elements. Use std::make_move_iterator to
+    // move the elements. Return false when the queue is closed.
+    template<class Iterator>
+    bool Push(Iterator first, Iterator last) {
+        std::unique_lock<std::mutex> lck = Lock();
+        if (closed_) return false;
+        size_t num = 0;
+        for (; first != last; ++first, ++num) {
+            bool was_empty = queue_ptr_->empty();
+            queue_ptr_->push(*first);
+            AfterPush(was_empty);
+        }
+        int waiters = waiters_;
+        lck.unlock();
+        if (num >= static_cast<size_t>(waiters)) {
+            if (waiters > 0) cv_.notify_all();
+        }
+        else {
+            for (size_t i = 0; i < num; i++) cv_.notify_one();
+        }
+        return true;
     }
 
     // If the type of value is not copy assignable, disable this method.
@@ -51,75 +213,322 @@ public:
         class = typename std::enable_if<
             std::is_convertible<Value, Type>::value>::type>
     bool Front(Type* result) {
-        std::lock_guard<std::mutex> lck(mtx_);
-        if (Empty()) return false;
-        if (result != NULL) *result = queue_ptr_->front();
+        std::unique_lock<std::mutex> lck = Lock();
+        if (queue_ptr_->empty()) return false;
+        if (result != NULL) *result = QueueAdapter<Queue>::Front(*queue_ptr_);
         return true;
     }
 
     // Get the element in the front of the queue and pop it.
     // Return false when the queue is empty.
     bool Pop(Value* result) {
-        std::lock_guard<std::mutex> lck(mtx_);
-        if (Empty()) return false;
-        if (result != NULL) *result = std::move(queue_ptr_->front());
+        std::unique_lock<std::mutex> lck = Lock();
+        if (queue_ptr_->empty()) return false;
+        if (result != NULL) *result = std::move(QueueAdapter<Queue>::Front(*queue_ptr_));
         queue_ptr_->pop();
+        AfterPop(1);
         return true;
     }
 
     // Pop the whole queue.
     std::unique_ptr<Queue> PopAll() {
-        std::lock_guard<std::mutex> lck(mtx_);
+        std::unique_lock<std::mutex> lck = Lock();
         std::unique_ptr<Queue> result(new Queue());
         std::swap(result, queue_ptr_);
+        AfterPop(result->size());
         return result;
     }
 
-    // Wait until the queue is not empty or the queue is shutdown.
-    // Return false when the queue is empty.
+    // Add the notifier which is notified on every push and close.
+    void AddNotifier(const std::shared_ptr<QueueNotifier>& notifier) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        notifier_list_.push_back(notifier);
+    }
+
+    void RemoveNotifier(const std::shared_ptr<QueueNotifier>& notifier) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        notifier_list_.erase(std::remove(notifier_list_.begin(),
+            notifier_list_.end(), notifier), notifier_list_.end());
+    }
+
+#ifdef __linux__
+    // Get the eventfd which is readable while the queue is not empty or
+    // closed, so the queue can be added to an epoll loop. The fd is owned
+    // by the queue, DO NOT read it. Return -1 on error.
+    int EventFd() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        if (event_fd_ < 0) {
+            event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            SetEvent(closed_ || !queue_ptr_->empty());
+        }
+        return event_fd_;
+    }
+#endif // __linux__
+
+    // Enable the statistics, it costs a few clock reads per operation.
+    void EnableStats(bool enable = true) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        if (enable == stats_enabled_) return;
+        stats_enabled_ = enable;
+        stats_.stamp_list.clear();
+        // The elements already in the queue have no enqueue time.
+        stats_.unstamped = queue_ptr_->size();
+        if (enable) ResetStatsImpl();
+    }
+
+    SafeQueueStats GetStats();
+
+    void ResetStats() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        ResetStatsImpl();
+    }
+
+    // Call func with the underlying queue in the critical region,
+    // e.g. to read the counters of a custom queue.
+    template<class Func>
+    void Inspect(Func&& func) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        func(static_cast<const Queue&>(*queue_ptr_));
+    }
+
+    // Wait until the queue is not empty or the queue is closed.
+    // Return false when the queue is closed and drained.
     bool Wait() {
         std::unique_lock<std::mutex> lck(mtx_);
-        cv_.wait(lck, [this] { return shutdown_ || !Empty(); });
-        return !Empty();
+        WaitLocked(&lck, NULL);
+        return !queue_ptr_->empty();
     }
 
-    // Wait with timeout.
+    // Wait with timeout, return false when it is timeout or the queue is
+    // closed and drained.
     template<class Rep, class Period>
     bool WaitFor(const std::chrono::duration<Rep, Period>& timeout) {
+        return WaitUntil(Deadline(timeout));
+    }
+
+    bool WaitUntil(const std::chrono::steady_clock::time_point& deadline) {
         std::unique_lock<std::mutex> lck(mtx_);
-        cv_.wait(lck, timeout, [this] { return shutdown_ || !Empty(); });
-        return !Empty();
+        WaitLocked(&lck, &deadline);
+        return !queue_ptr_->empty();
     }
 
     // Get the element in the front of the queue and pop it.
-    // It will be BLOCKED until the queue is not empty or shutdown.
+    // It will be BLOCKED until the queue is not empty or closed.
+    // Return false only when the queue is closed and drained.
     bool Get(Value* result) {
-        std::unique_lock<std::mutex> lck(mtx_);
-        cv_.wait(lck, [this] { return shutdown_ || !Empty(); });
-        if (Empty()) return false;
-        if (result != NULL) *result = std::move(queue_ptr_->front());
+        std::unique_lock<std::mutex> lck = Lock();
+        WaitLocked(&lck, NULL);
+        if (queue_ptr_->empty()) return false;
+        if (result != NULL) *result = std::move(QueueAdapter<Queue>::Front(*queue_ptr_));
         queue_ptr_->pop();
+        AfterPop(1);
         return true;
     }
 
-    // Get with timeout.
+    // Get with timeout, return false when it is timeout or the queue is
+    // closed and drained. Use GetFor to tell them apart.
     template<class Rep, class Period>
     bool Get(Value* result, const std::chrono::duration<Rep, Period>& timeout) {
-        std::unique_lock<std::mutex> lck(mtx_);
-        cv_.wait(lck, timeout, [this] { return shutdown_ || !Empty(); });
-        if (Empty()) return false;
-        if (result != NULL) *result = std::move(queue_ptr_->front());
+        return GetFor(result, timeout) == QueueStatus::kSuccess;
+    }
+
+    template<class Rep, class Period>
+    QueueStatus GetFor(Value* result,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        return GetUntil(result, Deadline(timeout));
+    }
+
+    QueueStatus GetUntil(Value* result,
+            const std::chrono::steady_clock::time_point& deadline) {
+        std::unique_lock<std::mutex> lck = Lock();
+        WaitLocked(&lck, &deadline);
+        if (queue_ptr_->empty()) {
+            return closed_ ? QueueStatus::kClosed : QueueStatus::kTimeout;
+        }
+        if (result != NULL) *result = std::move(QueueAdapter<Queue>::Front(*queue_ptr_));
         queue_ptr_->pop();
-        return true;
+        AfterPop(1);
+        return QueueStatus::kSuccess;
     }
 
 private:
-    bool shutdown_;
+    static const int kBucketNum = 40;
+
+    struct Stats {
+        std::chrono::steady_clock::time_point begin;
+        uint64_t push_count;
+        uint64_t pop_count;
+        uint64_t lock_contended;
+        uint64_t lock_wait_ns;
+        size_t max_depth;
+        // The enqueue time of the elements from the front of the queue,
+        // except the unstamped ones pushed before enabled.
+        std::deque<std::chrono::steady_clock::time_point> stamp_list;
+        size_t unstamped;
+        // Bucket i counts the time in queue in [2^i, 2^(i+1)) us.
+        uint64_t histogram[kBucketNum];
+    };
+
+    // Lock the mutex, and record the waiting time when it is contended.
+    std::unique_lock<std::mutex> Lock() {
+        if (!stats_enabled_.load(std::memory_order_relaxed)) {
+            return std::unique_lock<std::mutex>(mtx_);
+        }
+        std::unique_lock<std::mutex> lck(mtx_, std::try_to_lock);
+        if (!lck.owns_lock()) {
+            using namespace std::chrono;
+            steady_clock::time_point begin = steady_clock::now();
+            lck.lock();
+            // Check again, it may be disabled while waiting.
+            if (stats_enabled_) {
+                stats_.lock_contended++;
+                stats_.lock_wait_ns += duration_cast<nanoseconds>(
+                    steady_clock::now() - begin).count();
+            }
+        }
+        return lck;
+    }
+
+    // Wait until the queue is not empty or closed, or the deadline if it
+    // is not NULL. The waiting consumers are counted.
+    void WaitLocked(std::unique_lock<std::mutex>* lck,
+            const std::chrono::steady_clock::time_point* deadline) {
+        auto pred = [this] { return closed_ || !queue_ptr_->empty(); };
+        if (pred()) return;
+        waiters_++;
+        if (deadline == NULL) cv_.wait(*lck, pred);
+        else cv_.wait_until(*lck, *deadline, pred);
+        waiters_--;
+    }
+
+    void AfterPush(bool was_empty) {
+        size_.store(queue_ptr_->size(), std::memory_order_relaxed);
+        if (stats_enabled_) {
+            stats_.push_count++;
+            stats_.max_depth = std::max<size_t>(stats_.max_depth, queue_ptr_->size());
+            if (QueueAdapter<Queue>::kFifo) {
+                stats_.stamp_list.push_back(std::chrono::steady_clock::now());
+            }
+        }
+        for (auto& notifier : notifier_list_) notifier->Notify();
+        if (was_empty) SetEvent(true);
+    }
+
+    void AfterPop(size_t popped) {
+        size_.store(queue_ptr_->size(), std::memory_order_relaxed);
+        if (stats_enabled_) RecordPop(popped);
+        if (queue_ptr_->empty() && !closed_) SetEvent(false);
+    }
+
+    void RecordPop(size_t popped);
+
+    // Reset the counters, the enqueue time of the elements is kept.
+    void ResetStatsImpl() {
+        Stats stats = Stats();
+        stats.begin = std::chrono::steady_clock::now();
+        stats.stamp_list.swap(stats_.stamp_list);
+        stats.unstamped = stats_.unstamped;
+        std::swap(stats, stats_);
+    }
+
+    // The upper bound of the bucket where the percentile is, in us.
+    double Percentile(uint64_t total, double percent);
+
+    // Make the eventfd readable or not.
+    void SetEvent(bool readable) {
+#ifdef __linux__
+        if (event_fd_ < 0) return;
+        eventfd_t val = 0;
+        if (readable) eventfd_write(event_fd_, 1);
+        else eventfd_read(event_fd_, &val);
+#endif // __linux__
+    }
+
+    template<class Rep, class Period>
+    static std::chrono::steady_clock::time_point Deadline(
+            const std::chrono::duration<Rep, Period>& timeout) {
+        using namespace std::chrono;
+        return steady_clock::now() + duration_cast<steady_clock::duration>(timeout);
+    }
+
+private:
+    bool closed_;
     std::unique_ptr<Queue> queue_ptr_;
     std::mutex mtx_;
     std::condition_variable cv_;
+    std::vector<std::shared_ptr<QueueNotifier>> notifier_list_;
+    int event_fd_;
+    // The number of consumers waiting on cv_.
+    int waiters_;
+    // The size of the queue, for lock-free Size and Empty.
+    std::atomic<size_t> size_;
+    std::atomic<bool> stats_enabled_;
+    Stats stats_;
 };
 
+template<class Value, class Queue>
+SafeQueueStats SafeQueue<Value, Queue>::GetStats() {
+    std::lock_guard<std::mutex> lck(mtx_);
+    using namespace std::chrono;
+    SafeQueueStats result;
+    result.push_count = stats_.push_count;
+    result.pop_count = stats_.pop_count;
+    double seconds = duration_cast<duration<double>>(
+        steady_clock::now() - stats_.begin).count();
+    result.push_rate = seconds > 0 ? stats_.push_count / seconds : 0;
+    result.pop_rate = seconds > 0 ? stats_.pop_count / seconds : 0;
+    result.lock_contended = stats_.lock_contended;
+    result.lock_wait_ns = stats_.lock_wait_ns;
+    result.max_depth = stats_.max_depth;
+    uint64_t total = 0;
+    for (int i = 0; i < kBucketNum; i++) total += stats_.histogram[i];
+    result.time_in_queue_p50_us = Percentile(total, 0.5);
+    result.time_in_queue_p90_us = Percentile(total, 0.9);
+    result.time_in_queue_p99_us = Percentile(total, 0.99);
+    return result;
+}
+
+template<class Value, class Queue>
+void SafeQueue<Value, Queue>::RecordPop(size_t popped) {
+    using namespace std::chrono;
+    stats_.pop_count += popped;
+    if (!QueueAdapter<Queue>::kFifo) return;
+    steady_clock::time_point now = steady_clock::now();
+    for (size_t i = 0; i < popped; i++) {
+        if (stats_.unstamped > 0) {
+            stats_.unstamped--;
+            continue;
+        }
+        if (stats_.stamp_list.empty()) break;
+        uint64_t us = duration_cast<microseconds>(
+            now - stats_.stamp_list.front()).count();
+        stats_.stamp_list.pop_front();
+        int bucket = 0;
+        while (us > 1 && bucket < kBucketNum - 1) {
+            us >>= 1;
+            bucket++;
+        }
+        stats_.histogram[bucket]++;
+    }
+}
+
+template<class Value, class Queue>
+double SafeQueue<Value, Queue>::Percentile(uint64_t total, double percent) {
+    if (total == 0) return 0;
+    uint64_t count = 0;
+    for (int i = 0; i < kBucketNum; i++) {
+        count += stats_.histogram[i];
+        if (count >= total * percent) return static_cast<double>(2ULL << i);
+    }
+    return static_cast<double>(2ULL << (kBucketNum - 1));
+}
+
+// The element with the highest priority is fetched first.
+// Compare MUST be default constructible.
+template<class Value, class Compare = std::less<Value>>
+using SafePriorityQueue = SafeQueue<Value,
+    std::priority_queue<Value, std::vector<Value>, Compare>>;
+
 } // namespace iter
 
 #endif // ITER_SAFE_QUEUE_HPP
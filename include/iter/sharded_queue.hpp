@@ -0,0 +1,222 @@
+#ifndef ITER_SHARDED_QUEUE_HPP
+#define ITER_SHARDED_QUEUE_HPP
+
+#include <iter/safe_queue.hpp>
+#include <iter/thread_index.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+
+namespace iter {
+
+// A queue consist of several lanes, each lane has its own lock.
+// Producers push to the lane picked by the calling thread, consumers
+// fetch from all the lanes in turn. The order is FIFO within one lane,
+// so the elements pushed by one thread keep their order.
+template<class Value, class Queue = std::queue<Value>>
+class ShardedQueue {
+public:
+    typedef Value ValueType;
+    typedef Queue QueueType;
+
+    // If lane_num < 1, it will be fixed to the number of hardware threads.
+    explicit ShardedQueue(int lane_num = 0);
+
+    ~ShardedQueue() { Close(); }
+
+    int LaneNum() { return lane_num_; }
+
+    size_t Size() { return size_.load(); }
+
+    bool Empty() { return Size() == 0; }
+
+    // Same as SafeQueue::Close.
+    void Close();
+
+    bool IsClosed() { return closed_.load(); }
+
+    // Push to the lane of the calling thread.
+    // Return false when the queue is closed, the value is discarded.
+    bool Push(const Value& val) { return PushToLane(ThisThreadIndex(), val); }
+    bool Push(Value&& val) {
+        return PushToLane(ThisThreadIndex(), std::move(val));
+    }
+
+    // Push to the specified lane, e.g. picked by the hash of a key.
+    bool PushToLane(unsigned lane, const Value& val);
+    bool PushToLane(unsigned lane, Value&& val);
+
+    // Get the element in the front of one lane and pop it.
+    // Return false when all the lanes are empty.
+    bool Pop(Value* result);
+
+    // Same as the SafeQueue ones.
+    bool Get(Value* result);
+
+    template<class Rep, class Period>
+    QueueStatus GetFor(Value* result,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        using namespace std::chrono;
+        return GetUntil(result,
+            steady_clock::now() + duration_cast<steady_clock::duration>(timeout));
+    }
+
+    QueueStatus GetUntil(Value* result,
+            const std::chrono::steady_clock::time_point& deadline);
+
+    // Disable copy constructor and copy assignment operator.
+    ShardedQueue(const ShardedQueue&) = delete;
+    ShardedQueue& operator = (const ShardedQueue&) = delete;
+
+private:
+    struct Lane {
+        std::mutex mtx;
+        Queue queue;
+        std::atomic<size_t> size;
+        // Keep the lanes from sharing cache line.
+        char padding[64];
+
+        Lane() : size(0) {}
+    };
+
+    template<class Type>
+    bool PushImpl(unsigned lane, Type&& val);
+
+    // Pop from the lane, return false when it is empty.
+    bool PopLane(Lane* lane, Value* result);
+
+    // Wait until there are elements, the queue is closed or timeout.
+    // Wait without timeout when the deadline is NULL.
+    void Wait(const std::chrono::steady_clock::time_point* deadline);
+
+private:
+    int lane_num_;
+    std::unique_ptr<Lane[]> lane_list_;
+    std::atomic<bool> closed_;
+    // The total number of elements in all the lanes.
+    std::atomic<size_t> size_;
+    // The number of consumers blocked in Get.
+    std::atomic<int> waiters_;
+    std::mutex wait_mtx_;
+    std::condition_variable wait_cv_;
+};
+
+template<class Value, class Queue>
+ShardedQueue<Value, Queue>::ShardedQueue(int lane_num) :
+        lane_num_(lane_num), closed_(false), size_(0), waiters_(0) {
+    if (lane_num_ < 1) {
+        lane_num_ = std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+    lane_list_.reset(new Lane[lane_num_]);
+}
+
+template<class Value, class Queue>
+void ShardedQueue<Value, Queue>::Close() {
+    { // Critical region, no push is in progress on any lane.
+        for (int i = 0; i < lane_num_; i++) lane_list_[i].mtx.lock();
+        closed_ = true;
+        for (int i = 0; i < lane_num_; i++) lane_list_[i].mtx.unlock();
+    }
+    { // Critical region.
+        std::lock_guard<std::mutex> lck(wait_mtx_);
+    }
+    wait_cv_.notify_all();
+}
+
+template<class Value, class Queue>
+bool ShardedQueue<Value, Queue>::PushToLane(unsigned lane, const Value& val) {
+    return PushImpl(lane, val);
+}
+
+template<class Value, class Queue>
+bool ShardedQueue<Value, Queue>::PushToLane(unsigned lane, Value&& val) {
+    return PushImpl(lane, std::move(val));
+}
+
+template<class Value, class Queue>
+template<class Type>
+bool ShardedQueue<Value, Queue>::PushImpl(unsigned lane, Type&& val) {
+    Lane& l = lane_list_[lane % lane_num_];
+    { // Critical region.
+        std::lock_guard<std::mutex> lck(l.mtx);
+        if (closed_) return false;
+        l.queue.push(std::forward<Type>(val));
+        l.size++;
+        size_++;
+    }
+    // Only touch the shared wait mutex when someone is waiting.
+    if (waiters_ > 0) {
+        { // Critical region.
+            std::lock_guard<std::mutex> lck(wait_mtx_);
+        }
+        wait_cv_.notify_one();
+    }
+    return true;
+}
+
+template<class Value, class Queue>
+bool ShardedQueue<Value, Queue>::PopLane(Lane* lane, Value* result) {
+    if (lane->size.load(std::memory_order_relaxed) == 0) return false;
+    std::lock_guard<std::mutex> lck(lane->mtx);
+    if (lane->queue.empty()) return false;
+    if (result != NULL) *result = std::move(lane->queue.front());
+    lane->queue.pop();
+    lane->size--;
+    size_--;
+    return true;
+}
+
+template<class Value, class Queue>
+bool ShardedQueue<Value, Queue>::Pop(Value* result) {
+    // Each consumer starts from a different lane in turn.
+    thread_local unsigned cursor = ThisThreadIndex();
+    unsigned start = cursor++;
+    for (int i = 0; i < lane_num_; i++) {
+        if (PopLane(&lane_list_[(start + i) % lane_num_], result)) return true;
+    }
+    return false;
+}
+
+template<class Value, class Queue>
+void ShardedQueue<Value, Queue>::Wait(
+        const std::chrono::steady_clock::time_point* deadline) {
+    std::unique_lock<std::mutex> lck(wait_mtx_);
+    waiters_++;
+    auto pred = [this] { return closed_ || size_ > 0; };
+    if (deadline == NULL) wait_cv_.wait(lck, pred);
+    else wait_cv_.wait_until(lck, *deadline, pred);
+    waiters_--;
+}
+
+template<class Value, class Queue>
+bool ShardedQueue<Value, Queue>::Get(Value* result) {
+    while (!Pop(result)) {
+        if (closed_ && size_ == 0) return false;
+        Wait(NULL);
+    }
+    return true;
+}
+
+template<class Value, class Queue>
+QueueStatus ShardedQueue<Value, Queue>::GetUntil(Value* result,
+        const std::chrono::steady_clock::time_point& deadline) {
+    while (!Pop(result)) {
+        if (closed_ && size_ == 0) return QueueStatus::kClosed;
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return QueueStatus::kTimeout;
+        }
+        Wait(&deadline);
+    }
+    return QueueStatus::kSuccess;
+}
+
+} // namespace iter
+
+#endif // ITER_SHARDED_QUEUE_HPP
@@ -0,0 +1,404 @@
+#ifndef ITER_SHM_QUEUE_HPP
+#define ITER_SHM_QUEUE_HPP
+
+#include <iter/safe_queue.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace iter {
+
+// A bounded queue lives in a POSIX shared memory segment, it can be used
+// by several processes on one host, e.g. an ingest process and a worker
+// process. The records are copied into the segment once, blocked
+// producers and consumers wait on process-shared futex.
+// Record MUST be trivially copyable.
+template<class Record>
+class ShmQueue {
+    static_assert(std::is_trivially_copyable<Record>::value,
+        "Record of ShmQueue must be trivially copyable.");
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+        "ShmQueue requires address-free atomics.");
+
+public:
+    typedef Record RecordType;
+
+    static const uint32_t kMaxCapacity = 1u << 31;
+
+    ShmQueue() : header_(NULL), cell_list_(NULL), map_size_(0) {}
+
+    ~ShmQueue() { Detach(); }
+
+    // Create a new segment with the name like "/my_queue", the capacity
+    // will be rounded up to the power of 2, and at most kMaxCapacity.
+    // Return false when the segment already exists or on any error.
+    bool Create(const std::string& name, uint32_t capacity);
+
+    // Attach the segment created by another process.
+    // Return false when it does not exist or does not match Record.
+    bool Open(const std::string& name);
+
+    // Remove the name of the segment, the attached ones are not affected.
+    static bool Unlink(const std::string& name) {
+        return shm_unlink(name.c_str()) == 0;
+    }
+
+    bool IsAttached() { return header_ != NULL; }
+
+    // Return 0 when not attached.
+    uint32_t Capacity() { return IsAttached() ? header_->mask + 1 : 0; }
+
+    // The approximate number of records in the queue.
+    size_t Size();
+
+    bool Empty() { return Size() == 0; }
+
+    // Same as SafeQueue::Close, it is visible to all the processes.
+    // The pushes racing with it either fail, or their records are still
+    // fetched before the consumers see kClosed.
+    void Close();
+
+    // The queue not attached is regarded as closed, so the pushes and the
+    // gets on it fail instead of blocking.
+    bool IsClosed() { return !IsAttached() || header_->closed.load() != 0; }
+
+    // Return false when the queue is full or closed.
+    bool TryPush(const Record& record);
+
+    // It will be BLOCKED while the queue is full.
+    // Return false when the queue is closed.
+    bool Push(const Record& record);
+
+    // Return false when the queue is empty.
+    bool Pop(Record* result);
+
+    // Same as SafeQueue::Get.
+    bool Get(Record* result) {
+        return Fetch(result, NULL) == QueueStatus::kSuccess;
+    }
+
+    template<class Rep, class Period>
+    QueueStatus GetFor(Record* result,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        using namespace std::chrono;
+        return GetUntil(result,
+            steady_clock::now() + duration_cast<steady_clock::duration>(timeout));
+    }
+
+    QueueStatus GetUntil(Record* result,
+            const std::chrono::steady_clock::time_point& deadline) {
+        return Fetch(result, &deadline);
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    ShmQueue(const ShmQueue&) = delete;
+    ShmQueue& operator = (const ShmQueue&) = delete;
+
+private:
+    static const uint32_t kMagic = 0x49514d53;
+
+    struct Header {
+        // Written last by the creator, the segment is ready once it is set.
+        std::atomic<uint32_t> magic;
+        uint32_t mask;
+        uint32_t record_size;
+        std::atomic<uint32_t> closed;
+        // Consumers wait on push_seq, producers wait on pop_seq.
+        std::atomic<uint32_t> push_seq;
+        std::atomic<uint32_t> pop_waiters;
+        std::atomic<uint32_t> pop_seq;
+        std::atomic<uint32_t> push_waiters;
+        // The producers between checking closed and publishing the record.
+        std::atomic<uint32_t> pushing;
+        char padding0[28];
+        std::atomic<uint64_t> enqueue_pos;
+        char padding1[56];
+        std::atomic<uint64_t> dequeue_pos;
+        char padding2[56];
+    };
+
+    // The sequence of a cell is pos when it is free for the record at
+    // position pos, and pos + 1 when the record is written.
+    struct Cell {
+        std::atomic<uint64_t> seq;
+        Record record;
+    };
+
+    static size_t MapSize(uint32_t capacity) {
+        return sizeof(Header) + sizeof(Cell) * capacity;
+    }
+
+    bool Map(int fd, size_t size);
+
+    // Claim a cell and publish the record, return false when full.
+    bool Enqueue(const Record& record);
+
+    void Detach();
+
+    QueueStatus Fetch(Record* result,
+            const std::chrono::steady_clock::time_point* deadline);
+
+    // Sleep while the word is equal to val, until woken up or deadline.
+    static void FutexWait(std::atomic<uint32_t>* word, uint32_t val,
+            const std::chrono::steady_clock::time_point* deadline);
+
+    static void FutexWake(std::atomic<uint32_t>* word, int num);
+
+    // Bump the word and wake up the waiters if there are any.
+    static void Notify(std::atomic<uint32_t>* word,
+            std::atomic<uint32_t>* waiters, int num);
+
+private:
+    Header* header_;
+    Cell* cell_list_;
+    size_t map_size_;
+};
+
+template<class Record>
+bool ShmQueue<Record>::Create(const std::string& name, uint32_t capacity) {
+    if (IsAttached() || capacity > kMaxCapacity) return false;
+    uint32_t size = 1;
+    while (size < capacity) size <<= 1;
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return false;
+    if (ftruncate(fd, MapSize(size)) != 0 || !Map(fd, MapSize(size))) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    close(fd);
+
+    header_ = new (header_) Header();
+    header_->mask = size - 1;
+    header_->record_size = sizeof(Record);
+    header_->closed = 0;
+    header_->push_seq = 0;
+    header_->pop_waiters = 0;
+    header_->pop_seq = 0;
+    header_->push_waiters = 0;
+    header_->pushing = 0;
+    header_->enqueue_pos = 0;
+    header_->dequeue_pos = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        new (&cell_list_[i].seq) std::atomic<uint64_t>(i);
+    }
+    header_->magic.store(kMagic, std::memory_order_release);
+    return true;
+}
+
+template<class Record>
+bool ShmQueue<Record>::Open(const std::string& name) {
+    if (IsAttached()) return false;
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) return false;
+    struct stat st;
+    bool succ = fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= sizeof(Header) &&
+        Map(fd, st.st_size);
+    close(fd);
+    if (!succ) return false;
+    if (header_->magic.load(std::memory_order_acquire) != kMagic ||
+            header_->record_size != sizeof(Record) ||
+            MapSize(header_->mask + 1) != map_size_) {
+        Detach();
+        return false;
+    }
+    return true;
+}
+
+template<class Record>
+bool ShmQueue<Record>::Map(int fd, size_t size) {
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) return false;
+    header_ = static_cast<Header*>(addr);
+    cell_list_ = reinterpret_cast<Cell*>(header_ + 1);
+    map_size_ = size;
+    return true;
+}
+
+template<class Record>
+void ShmQueue<Record>::Detach() {
+    if (header_ == NULL) return;
+    munmap(header_, map_size_);
+    header_ = NULL;
+    cell_list_ = NULL;
+    map_size_ = 0;
+}
+
+template<class Record>
+size_t ShmQueue<Record>::Size() {
+    if (!IsAttached()) return 0;
+    uint64_t dequeue_pos = header_->dequeue_pos.load(std::memory_order_relaxed);
+    uint64_t enqueue_pos = header_->enqueue_pos.load(std::memory_order_relaxed);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+template<class Record>
+void ShmQueue<Record>::Close() {
+    if (!IsAttached()) return;
+    header_->closed.store(1);
+    header_->push_seq.fetch_add(1);
+    header_->pop_seq.fetch_add(1);
+    FutexWake(&header_->push_seq, INT32_MAX);
+    FutexWake(&header_->pop_seq, INT32_MAX);
+}
+
+template<class Record>
+bool ShmQueue<Record>::TryPush(const Record& record) {
+    if (IsClosed()) return false;
+    // Registered before checking closed again, so a consumer seeing closed
+    // also sees this push in flight, and waits for it.
+    header_->pushing.fetch_add(1);
+    bool succ = !IsClosed() && Enqueue(record);
+    header_->pushing.fetch_sub(1);
+    return succ;
+}
+
+template<class Record>
+bool ShmQueue<Record>::Enqueue(const Record& record) {
+    uint64_t pos = header_->enqueue_pos.load(std::memory_order_relaxed);
+    Cell* cell = NULL;
+    while (true) {
+        cell = &cell_list_[pos & header_->mask];
+        uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq - pos);
+        if (diff == 0) {
+            if (header_->enqueue_pos.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = header_->enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    memcpy(&cell->record, &record, sizeof(Record));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    Notify(&header_->push_seq, &header_->pop_waiters, 1);
+    return true;
+}
+
+template<class Record>
+bool ShmQueue<Record>::Push(const Record& record) {
+    while (true) {
+        if (TryPush(record)) return true;
+        if (IsClosed()) return false;
+        uint32_t seq = header_->pop_seq.load();
+        header_->push_waiters.fetch_add(1);
+        bool succ = TryPush(record);
+        if (!succ && !IsClosed()) FutexWait(&header_->pop_seq, seq, NULL);
+        header_->push_waiters.fetch_sub(1);
+        if (succ) return true;
+    }
+}
+
+template<class Record>
+bool ShmQueue<Record>::Pop(Record* result) {
+    if (!IsAttached()) return false;
+    uint64_t pos = header_->dequeue_pos.load(std::memory_order_relaxed);
+    Cell* cell = NULL;
+    while (true) {
+        cell = &cell_list_[pos & header_->mask];
+        uint64_t seq = cell->seq.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq - (pos + 1));
+        if (diff == 0) {
+            if (header_->dequeue_pos.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = header_->dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    if (result != NULL) memcpy(result, &cell->record, sizeof(Record));
+    cell->seq.store(pos + header_->mask + 1, std::memory_order_release);
+    Notify(&header_->pop_seq, &header_->push_waiters, 1);
+    return true;
+}
+
+template<class Record>
+QueueStatus ShmQueue<Record>::Fetch(Record* result,
+        const std::chrono::steady_clock::time_point* deadline) {
+    while (true) {
+        if (Pop(result)) return QueueStatus::kSuccess;
+        bool timeout = deadline != NULL &&
+            std::chrono::steady_clock::now() >= *deadline;
+        if (IsClosed()) {
+            if (!IsAttached()) return QueueStatus::kClosed;
+            // No more push after the ones in flight, drain them.
+            if (header_->pushing.load() == 0) {
+                if (Pop(result)) return QueueStatus::kSuccess;
+                if (Size() == 0) return QueueStatus::kClosed;
+            }
+            if (timeout) return QueueStatus::kTimeout;
+            std::this_thread::yield();
+            continue;
+        }
+        if (timeout) return QueueStatus::kTimeout;
+        uint32_t seq = header_->push_seq.load();
+        header_->pop_waiters.fetch_add(1);
+        bool succ = Pop(result);
+        if (!succ && !IsClosed()) FutexWait(&header_->push_seq, seq, deadline);
+        header_->pop_waiters.fetch_sub(1);
+        if (succ) return QueueStatus::kSuccess;
+    }
+}
+
+template<class Record>
+void ShmQueue<Record>::FutexWait(std::atomic<uint32_t>* word, uint32_t val,
+        const std::chrono::steady_clock::time_point* deadline) {
+    struct timespec ts;
+    struct timespec* timeout = NULL;
+    if (deadline != NULL) {
+        using namespace std::chrono;
+        auto left = duration_cast<nanoseconds>(*deadline - steady_clock::now());
+        if (left.count() <= 0) return;
+        ts.tv_sec = left.count() / 1000000000;
+        ts.tv_nsec = left.count() % 1000000000;
+        timeout = &ts;
+    }
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word),
+        FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+template<class Record>
+void ShmQueue<Record>::FutexWake(std::atomic<uint32_t>* word, int num) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word),
+        FUTEX_WAKE, num, NULL, NULL, 0);
+}
+
+template<class Record>
+void ShmQueue<Record>::Notify(std::atomic<uint32_t>* word,
+        std::atomic<uint32_t>* waiters, int num) {
+    // Order the record before checking waiters, pairs with the waiter
+    // which registers itself before checking the queue again.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters->load(std::memory_order_relaxed) == 0) return;
+    word->fetch_add(1);
+    FutexWake(word, num);
+}
+
+} // namespace iter
+
+#endif // ITER_SHM_QUEUE_HPP
@@ -0,0 +1,133 @@
+#ifndef ITER_SLOT_REGISTRY_HPP
+#define ITER_SLOT_REGISTRY_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace iter {
+
+// A registry on a slot map, same interface as Registry. The nodes are
+// stored contiguously, and the handle is made of the index of its slot
+// and the generation of the slot, so a lookup is one indirection without
+// hashing. A slot is reused after its node is removed with the generation
+// increased, the stale handles of the removed nodes are never valid again
+// until the 32-bit generation wraps around.
+// The handle 0 is never used.
+template<class Node>
+class SlotRegistry {
+public:
+    typedef uint64_t Handle;
+
+    SlotRegistry() : free_head_(kNone) {}
+
+    // Return the handle of this node.
+    Handle Register(const Node& node) { return RegisterImpl(node); }
+    Handle Register(Node&& node) { return RegisterImpl(std::move(node)); }
+
+    // Return false if the handle is not registered.
+    bool Remove(Handle handle);
+
+    // Check whether it is registered.
+    bool IsRegistered(Handle handle) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return Find(handle) != NULL;
+    }
+
+    // Get the node corresponding to the handle.
+    // Throw std::out_of_range if it is not registered, same as Registry.
+    Node Get(Handle handle) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        const Node* node = Find(handle);
+        if (node == NULL) throw std::out_of_range("SlotRegistry::Get");
+        return *node;
+    }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return node_list_.size();
+    }
+
+private:
+    static const uint32_t kNone = UINT32_MAX;
+
+    struct Slot {
+        // The index in node_list_ if it is used, or the next free slot.
+        uint32_t pos;
+        // Increased once the node is removed, it is never 0.
+        uint32_t generation;
+    };
+
+    static Handle MakeHandle(uint32_t index, uint32_t generation) {
+        return (static_cast<uint64_t>(generation) << 32) | index;
+    }
+
+    template<class Type>
+    Handle RegisterImpl(Type&& node);
+
+    // Return NULL if the handle is not registered.
+    const Node* Find(Handle handle) {
+        uint32_t index = static_cast<uint32_t>(handle);
+        if (index >= slot_list_.size()) return NULL;
+        const Slot& slot = slot_list_[index];
+        if (slot.generation != static_cast<uint32_t>(handle >> 32)) return NULL;
+        // The free slot links to the next one, never back from its node.
+        if (slot.pos >= node_list_.size() || node_slot_[slot.pos] != index) return NULL;
+        return &node_list_[slot.pos];
+    }
+
+private:
+    std::vector<Slot> slot_list_;
+    // The nodes are packed, with the index of their slots.
+    std::vector<Node> node_list_;
+    std::vector<uint32_t> node_slot_;
+    // The head of the free slot list.
+    uint32_t free_head_;
+    std::mutex mtx_;
+};
+
+template<class Node>
+template<class Type>
+typename SlotRegistry<Node>::Handle SlotRegistry<Node>::RegisterImpl(Type&& node) {
+    std::lock_guard<std::mutex> lck(mtx_);
+    uint32_t index = free_head_;
+    if (index == kNone) {
+        index = slot_list_.size();
+        slot_list_.push_back(Slot{0, 1});
+    }
+    else {
+        free_head_ = slot_list_[index].pos;
+    }
+    node_list_.push_back(std::forward<Type>(node));
+    node_slot_.push_back(index);
+    slot_list_[index].pos = node_list_.size() - 1;
+    return MakeHandle(index, slot_list_[index].generation);
+}
+
+template<class Node>
+bool SlotRegistry<Node>::Remove(Handle handle) {
+    std::lock_guard<std::mutex> lck(mtx_);
+    if (Find(handle) == NULL) return false;
+    uint32_t index = static_cast<uint32_t>(handle);
+    Slot& slot = slot_list_[index];
+    // Move the last node into the hole to keep the nodes packed.
+    uint32_t last = node_list_.size() - 1;
+    if (slot.pos != last) {
+        node_list_[slot.pos] = std::move(node_list_[last]);
+        node_slot_[slot.pos] = node_slot_[last];
+        slot_list_[node_slot_[last]].pos = slot.pos;
+    }
+    node_list_.pop_back();
+    node_slot_.pop_back();
+    // Invalidate the handles of this slot.
+    if (++slot.generation == 0) slot.generation = 1;
+    slot.pos = free_head_;
+    free_head_ = index;
+    return true;
+}
+
+} // namespace iter
+
+#endif // ITER_SLOT_REGISTRY_HPP
@@ -0,0 +1,108 @@
+#ifndef ITER_SNAPSHOT_HPP
+#define ITER_SNAPSHOT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace iter {
+
+// A small trivially copyable value shared by a seqlock, e.g. a config of
+// some thresholds. The readers copy it out optimistically and retry when
+// it is written at the same time, so a read is a few loads without any
+// shared write. Use DoubleBuffer for the large ones, the readers may
+// retry forever under continuous writes.
+template<class Value>
+class Snapshot {
+    static_assert(std::is_trivially_copyable<Value>::value,
+        "Value of Snapshot must be trivially copyable.");
+    static_assert(std::is_default_constructible<Value>::value,
+        "Value of Snapshot must be default constructible.");
+
+public:
+    typedef Value ValueType;
+
+    Snapshot() : seq_(0) { Write(Value()); }
+
+    explicit Snapshot(const Value& val) : seq_(0) { Write(val); }
+
+    // Copy the value out.
+    Value Load() const {
+        Value result;
+        Load(&result);
+        return result;
+    }
+
+    // Same as above, and store the version into *version if it is not NULL.
+    void Load(Value* result, uint64_t* version = NULL) const;
+
+    void Store(const Value& val) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        Write(val);
+    }
+
+    // The number of stores since constructed.
+    uint64_t Version() const {
+        return seq_.load(std::memory_order_acquire) / 2 - 1;
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator = (const Snapshot&) = delete;
+
+private:
+    static const size_t kWords = (sizeof(Value) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    void Write(const Value& val);
+
+private:
+    // Odd while writing.
+    std::atomic<uint64_t> seq_;
+    // The value is kept in atomic words, so the racing reads are defined.
+    std::atomic<uint64_t> word_[kWords];
+    std::mutex mtx_;
+};
+
+template<class Value>
+void Snapshot<Value>::Load(Value* result, uint64_t* version) const {
+    uint64_t buffer[kWords];
+    while (true) {
+        uint64_t seq = seq_.load(std::memory_order_acquire);
+        // The writer may be preempted.
+        if (seq & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < kWords; i++) {
+            buffer[i] = word_[i].load(std::memory_order_relaxed);
+        }
+        // Order the loads of the words before checking the sequence again.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == seq) {
+            if (version != NULL) *version = seq / 2 - 1;
+            break;
+        }
+    }
+    memcpy(result, buffer, sizeof(Value));
+}
+
+template<class Value>
+void Snapshot<Value>::Write(const Value& val) {
+    uint64_t buffer[kWords] = {0};
+    memcpy(buffer, &val, sizeof(Value));
+    uint64_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    // Order the odd sequence before the stores of the words.
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; i++) {
+        word_[i].store(buffer[i], std::memory_order_relaxed);
+    }
+    seq_.store(seq + 2, std::memory_order_release);
+}
+
+} // namespace iter
+
+#endif // ITER_SNAPSHOT_HPP
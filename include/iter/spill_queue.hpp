@@ -0,0 +1,379 @@
+#ifndef ITER_SPILL_QUEUE_HPP
+#define ITER_SPILL_QUEUE_HPP
+
+#include <iter/fmtstr.hpp>
+#include <iter/safe_queue.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace iter {
+
+// Serialize the trivially copyable value by its bytes.
+template<class Value>
+struct PodSerializer {
+    static_assert(std::is_trivially_copyable<Value>::value,
+        "Value of PodSerializer must be trivially copyable.");
+
+    void Serialize(const Value& val, std::string* out) const {
+        out->append(reinterpret_cast<const char*>(&val), sizeof(Value));
+    }
+
+    bool Deserialize(const char* data, size_t size, Value* result) const {
+        if (size != sizeof(Value)) return false;
+        memcpy(result, data, size);
+        return true;
+    }
+};
+
+struct StringSerializer {
+    void Serialize(const std::string& val, std::string* out) const {
+        out->append(val);
+    }
+
+    bool Deserialize(const char* data, size_t size, std::string* result) const {
+        result->assign(data, size);
+        return true;
+    }
+};
+
+// A queue keeps at most memory_limit elements in memory, the overflowing
+// elements are serialized to append-only segment files under the
+// directory, and read back in order when the consumers catch up.
+// The segment files are removed once read, or when the queue is destroyed,
+// they are NOT meant to persist across restarts.
+template<class Value, class Serializer = PodSerializer<Value>>
+class SpillQueue {
+public:
+    typedef Value ValueType;
+
+    // The directory MUST exist.
+    SpillQueue(const std::string& dir, size_t memory_limit,
+        size_t segment_size = 64 << 20,
+        const Serializer& serializer = Serializer());
+
+    ~SpillQueue();
+
+    // The number of elements in memory and on disk.
+    size_t Size() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return memory_.size() + spilled_;
+    }
+
+    bool Empty() { return Size() == 0; }
+
+    // The number of elements on disk.
+    size_t Spilled() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return spilled_;
+    }
+
+    // The number of bytes written to disk since constructed.
+    uint64_t SpilledBytes() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return spilled_bytes_;
+    }
+
+    // The number of elements pushed successfully but lost since they
+    // failed to be flushed to disk.
+    uint64_t Lost() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return lost_;
+    }
+
+    // Same as SafeQueue::Close.
+    void Close() {
+        { // Critical region.
+            std::lock_guard<std::mutex> lck(mtx_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    bool IsClosed() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return closed_;
+    }
+
+    // Return false when the queue is closed or failed to write the disk,
+    // the value is discarded.
+    bool Push(const Value& val) { return PushImpl(val); }
+    bool Push(Value&& val) { return PushImpl(std::move(val)); }
+
+    // Same as the SafeQueue ones.
+    bool Pop(Value* result) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        if (!Ready()) return false;
+        Take(result);
+        return true;
+    }
+
+    bool Get(Value* result) {
+        std::unique_lock<std::mutex> lck(mtx_);
+        cv_.wait(lck, [this] { return closed_ || Ready(); });
+        if (!Ready()) return false;
+        Take(result);
+        return true;
+    }
+
+    template<class Rep, class Period>
+    QueueStatus GetFor(Value* result,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        using namespace std::chrono;
+        return GetUntil(result,
+            steady_clock::now() + duration_cast<steady_clock::duration>(timeout));
+    }
+
+    QueueStatus GetUntil(Value* result,
+            const std::chrono::steady_clock::time_point& deadline) {
+        std::unique_lock<std::mutex> lck(mtx_);
+        cv_.wait_until(lck, deadline, [this] { return closed_ || Ready(); });
+        if (!Ready()) {
+            return closed_ ? QueueStatus::kClosed : QueueStatus::kTimeout;
+        }
+        Take(result);
+        return QueueStatus::kSuccess;
+    }
+
+    // Disable copy constructor and copy assignment operator.
+    SpillQueue(const SpillQueue&) = delete;
+    SpillQueue& operator = (const SpillQueue&) = delete;
+
+private:
+    struct FileCloser {
+        void operator () (std::FILE* file) const { std::fclose(file); }
+    };
+    typedef std::unique_ptr<std::FILE, FileCloser> FilePtr;
+
+    template<class Type>
+    bool PushImpl(Type&& val);
+
+    // Append the element to the last segment.
+    bool Spill(const Value& val);
+
+    // Read the spilled elements back when the memory is empty.
+    // Return false when there is no element.
+    bool Ready();
+
+    void Take(Value* result) {
+        if (result != NULL) *result = std::move(memory_.front());
+        memory_.pop();
+    }
+
+    // The segment file with the bytes and the number of the complete
+    // records in it. The records beyond it may be partially written by a
+    // failed write.
+    struct Segment {
+        uint64_t id;
+        uint64_t size;
+        uint64_t count;
+    };
+
+    // Flush the last segment to make its records readable. When failed,
+    // the records not flushed are lost and the segment is closed.
+    bool FlushWriter();
+
+    std::string SegmentPath(uint64_t id) {
+        return FmtStr("%s/%016llx.spill", dir_.c_str(),
+            static_cast<unsigned long long>(id));
+    }
+
+    // Remove the first segment which is read.
+    void DropSegment();
+
+private:
+    std::string dir_;
+    size_t memory_limit_;
+    size_t segment_size_;
+    Serializer serializer_;
+    bool closed_;
+
+    std::queue<Value> memory_;
+    // The number of elements on disk.
+    size_t spilled_;
+    uint64_t spilled_bytes_;
+    uint64_t lost_;
+    // The segments not read yet, from the oldest one. The writer appends
+    // to the last one.
+    std::deque<Segment> segment_list_;
+    uint64_t next_segment_id_;
+    FilePtr writer_;
+    // The bytes of the last segment flushed to the file. The stdio buffer
+    // may be flushed in the middle of a record, so the reader only reads
+    // below it.
+    uint64_t writer_flushed_;
+    uint64_t writer_flushed_count_;
+    FilePtr reader_;
+    // The offset of the next record in the first segment.
+    uint64_t reader_pos_;
+    std::string buffer_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+template<class Value, class Serializer>
+SpillQueue<Value, Serializer>::SpillQueue(const std::string& dir,
+        size_t memory_limit, size_t segment_size, const Serializer& serializer) :
+        dir_(dir), memory_limit_(std::max<size_t>(memory_limit, 1)),
+        segment_size_(segment_size), serializer_(serializer), closed_(false),
+        spilled_(0), spilled_bytes_(0), lost_(0), next_segment_id_(0),
+        writer_flushed_(0), writer_flushed_count_(0), reader_pos_(0) {}
+
+template<class Value, class Serializer>
+SpillQueue<Value, Serializer>::~SpillQueue() {
+    Close();
+    reader_.reset();
+    writer_.reset();
+    for (auto& segment : segment_list_) std::remove(SegmentPath(segment.id).c_str());
+}
+
+template<class Value, class Serializer>
+template<class Type>
+bool SpillQueue<Value, Serializer>::PushImpl(Type&& val) {
+    { // Critical region.
+        std::lock_guard<std::mutex> lck(mtx_);
+        if (closed_) return false;
+        // Once spilled, the following elements go to disk to keep the order.
+        if (spilled_ == 0 && memory_.size() < memory_limit_) {
+            memory_.push(std::forward<Type>(val));
+        }
+        else if (!Spill(val)) {
+            return false;
+        }
+    }
+    cv_.notify_one();
+    return true;
+}
+
+template<class Value, class Serializer>
+bool SpillQueue<Value, Serializer>::Spill(const Value& val) {
+    if (writer_ == nullptr || segment_list_.back().size >= segment_size_) {
+        // Flush it here, the failure of the implicit flush by fclose is
+        // not seen.
+        if (writer_ != nullptr) FlushWriter();
+        uint64_t id = next_segment_id_++;
+        // The last segment is kept open by the reader if it is being read.
+        FilePtr file(std::fopen(SegmentPath(id).c_str(), "wb"));
+        if (file == nullptr) return false;
+        // Large buffer for the sequential write.
+        std::setvbuf(file.get(), NULL, _IOFBF, 1 << 20);
+        writer_ = std::move(file);
+        writer_flushed_ = 0;
+        writer_flushed_count_ = 0;
+        segment_list_.push_back(Segment{id, 0, 0});
+    }
+    buffer_.clear();
+    buffer_.resize(sizeof(uint32_t));
+    serializer_.Serialize(val, &buffer_);
+    uint32_t size = buffer_.size() - sizeof(uint32_t);
+    memcpy(&buffer_[0], &size, sizeof(uint32_t));
+    if (std::fwrite(buffer_.data(), 1, buffer_.size(), writer_.get())
+            != buffer_.size()) {
+        // A part of the record may be written, the following ones go to
+        // a new segment, and this one is read up to its last record.
+        if (writer_ != nullptr) FlushWriter();
+        writer_.reset();
+        return false;
+    }
+    segment_list_.back().size += buffer_.size();
+    segment_list_.back().count++;
+    spilled_bytes_ += buffer_.size();
+    spilled_++;
+    return true;
+}
+
+template<class Value, class Serializer>
+bool SpillQueue<Value, Serializer>::Ready() {
+    if (!memory_.empty()) return true;
+    while (spilled_ > 0 && memory_.size() < memory_limit_) {
+        const Segment& segment = segment_list_.front();
+        if (reader_pos_ >= segment.size) {
+            // The records are counted in spilled_, so the segment being
+            // written is never read to the end here.
+            if (segment_list_.size() == 1) break;
+            DropSegment();
+            continue;
+        }
+        // Make the buffered records of the last segment readable.
+        if (segment_list_.size() == 1 && writer_ != nullptr && !FlushWriter()) {
+            // The segment is cut to the records flushed, check it again.
+            continue;
+        }
+        if (reader_ == nullptr) {
+            reader_.reset(std::fopen(SegmentPath(segment.id).c_str(), "rb"));
+            if (reader_ == nullptr) break;
+            std::setvbuf(reader_.get(), NULL, _IOFBF, 1 << 20);
+            reader_pos_ = 0;
+        }
+        // Read past the end of file last time.
+        std::clearerr(reader_.get());
+        uint32_t size = 0;
+        bool succ = std::fread(&size, sizeof(uint32_t), 1, reader_.get()) == 1 &&
+            reader_pos_ + sizeof(uint32_t) + size <= segment.size;
+        if (succ) {
+            buffer_.resize(size);
+            succ = size == 0 || std::fread(&buffer_[0], 1, size, reader_.get()) == size;
+        }
+        if (!succ) {
+            // Never consume a part of the record, rewind and retry later.
+            std::fseek(reader_.get(), reader_pos_, SEEK_SET);
+            break;
+        }
+        reader_pos_ += sizeof(uint32_t) + size;
+        spilled_--;
+        // The record which can not be deserialized is skipped.
+        Value val;
+        if (serializer_.Deserialize(buffer_.data(), size, &val)) {
+            memory_.push(std::move(val));
+        }
+    }
+    // All the segments are read, start over.
+    if (spilled_ == 0 && !segment_list_.empty()) {
+        writer_.reset();
+        while (!segment_list_.empty()) DropSegment();
+    }
+    return !memory_.empty();
+}
+
+template<class Value, class Serializer>
+bool SpillQueue<Value, Serializer>::FlushWriter() {
+    Segment& segment = segment_list_.back();
+    if (writer_flushed_ == segment.size) return true;
+    if (std::fflush(writer_.get()) == 0) {
+        writer_flushed_ = segment.size;
+        writer_flushed_count_ = segment.count;
+        return true;
+    }
+    // Never wait for the records which can not be read.
+    uint64_t lost = segment.count - writer_flushed_count_;
+    lost_ += lost;
+    spilled_ -= lost;
+    segment.size = writer_flushed_;
+    segment.count = writer_flushed_count_;
+    writer_.reset();
+    return false;
+}
+
+template<class Value, class Serializer>
+void SpillQueue<Value, Serializer>::DropSegment() {
+    reader_.reset();
+    reader_pos_ = 0;
+    std::remove(SegmentPath(segment_list_.front().id).c_str());
+    segment_list_.pop_front();
+}
+
+} // namespace iter
+
+#endif // ITER_SPILL_QUEUE_HPP
@@ -0,0 +1,18 @@
+#ifndef ITER_THREAD_INDEX_HPP
+#define ITER_THREAD_INDEX_HPP
+
+#include <atomic>
+
+namespace iter {
+
+// Get the index of the calling thread, the indexes are assigned
+// sequentially from 0 in the order of the first call of each thread.
+inline unsigned ThisThreadIndex() {
+    static std::atomic<unsigned> counter(0);
+    thread_local unsigned index = counter++;
+    return index;
+}
+
+} // namespace iter
+
+#endif // ITER_THREAD_INDEX_HPP
@@ -0,0 +1,75 @@
+#include <iter/buffer_group.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace iter;
+
+TEST(UpdateTest, BufferGroup) {
+    BufferGroup<int, std::string> group;
+    auto ptr = group.Read();
+    EXPECT_EQ(*std::get<0>(*ptr), 0);
+    EXPECT_EQ(*std::get<1>(*ptr), "");
+    ptr.Reset();
+
+    group.Update(std::make_shared<int>(1), std::make_shared<std::string>("girigiri"));
+    ptr = group.Read();
+    EXPECT_EQ(*std::get<0>(*ptr), 1);
+    EXPECT_EQ(*std::get<1>(*ptr), "girigiri");
+    // Share the buffer beyond the snapshot.
+    std::shared_ptr<const std::string> dict = std::get<1>(*ptr);
+    ptr.Reset();
+
+    // The null one is not changed.
+    group.Update(std::make_shared<int>(2), nullptr);
+    ptr = group.Read();
+    EXPECT_EQ(*std::get<0>(*ptr), 2);
+    EXPECT_EQ(std::get<1>(*ptr), dict);
+    ptr.Reset();
+
+    BufferGroup<int, std::string>::Transaction transaction;
+    transaction.Set<1>(std::make_shared<std::string>("bilibili"));
+    group.Commit(transaction);
+    ptr = group.Read();
+    EXPECT_EQ(*std::get<0>(*ptr), 2);
+    EXPECT_EQ(*std::get<1>(*ptr), "bilibili");
+    EXPECT_EQ(*dict, "girigiri");
+}
+
+TEST(ConsistencyTest, BufferGroup) {
+    const int SUB = 4, NUM = 2000;
+    BufferGroup<int, std::vector<int>, std::string> group;
+    // The default string is not "0".
+    group.Update(nullptr, nullptr, std::make_shared<std::string>("0"));
+    std::atomic<bool> stop(false);
+    std::atomic<int> inconsistent(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&group, &stop, &inconsistent] {
+            while (!stop) {
+                auto ptr = group.Read();
+                int index = *std::get<0>(*ptr);
+                // The buffers are always from the same version.
+                if (static_cast<int>(std::get<1>(*ptr)->size()) != index ||
+                        *std::get<2>(*ptr) != std::to_string(index)) inconsistent ++;
+                ptr.Reset();
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (int i = 1; i <= NUM; i ++) {
+        BufferGroup<int, std::vector<int>, std::string>::Transaction transaction;
+        transaction.Set<0>(std::make_shared<int>(i));
+        transaction.Set<1>(std::make_shared<std::vector<int>>(i));
+        transaction.Set<2>(std::make_shared<std::string>(std::to_string(i)));
+        group.Commit(transaction);
+    }
+    stop = true;
+    for (auto& t : thread_list) t.join();
+    EXPECT_EQ(inconsistent, 0);
+    EXPECT_EQ(*std::get<0>(*group.Read()), NUM);
+}
@@ -0,0 +1,118 @@
+#include <iter/buffer_reloader.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace iter;
+
+bool LoadString(const std::string& path, std::string* buffer) {
+    std::ifstream fin(path);
+    if (!fin) return false;
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    *buffer = ss.str();
+    // Refuse the broken file.
+    return *buffer != "broken";
+}
+
+void WriteFile(const std::string& path, const std::string& content) {
+    std::ofstream fout(path);
+    fout << content;
+}
+
+// Wait until the reload count reaches num or timeout.
+bool WaitReloads(std::atomic<int>* reloads, int num) {
+    for (int i = 0; i < 500 && *reloads < num; i ++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return *reloads >= num;
+}
+
+TEST(ReloadTest, BufferReloader) {
+    char dir[] = "/tmp/buffer_reloader_XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != NULL);
+    std::string path = std::string(dir) + "/dict.txt";
+    WriteFile(path, "girigiri");
+
+    DoubleBuffer<std::string> db;
+    ThreadPool pool(1);
+    std::atomic<int> reloads(0);
+    {
+        BufferReloader<std::string> reloader(&db, &pool, path, LoadString,
+            [&reloads](const ReloadResult& result) {
+                std::cout << "Reload " << (result.success ? "succeeded" : "failed")
+                    << " elapsed time " << result.elapsed_ms << " ms" << std::endl;
+                reloads ++;
+            },
+            std::chrono::milliseconds(50));
+        EXPECT_TRUE(reloader.Reload().get());
+        EXPECT_EQ(*db.Read(), "girigiri");
+        ASSERT_TRUE(reloader.Start());
+
+        // The rapid changes are debounced into one reload.
+        for (int i = 0; i < 5; i ++) WriteFile(path, "bilibili" + std::to_string(i));
+        EXPECT_TRUE(WaitReloads(&reloads, 2));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        EXPECT_EQ(reloads, 2);
+        EXPECT_EQ(*db.Read(), "bilibili4");
+
+        // The broken file is reported and not published.
+        WriteFile(path, "broken");
+        EXPECT_TRUE(WaitReloads(&reloads, 3));
+        ReloadResult result = reloader.LastResult();
+        EXPECT_FALSE(result.success);
+        EXPECT_EQ(result.reload_count, 3);
+        EXPECT_EQ(result.failure_count, 1);
+        EXPECT_EQ(*db.Read(), "bilibili4");
+
+        // Replace the file by rename.
+        std::string tmp_path = std::string(dir) + "/dict.tmp";
+        WriteFile(tmp_path, "girigiri");
+        EXPECT_EQ(std::rename(tmp_path.c_str(), path.c_str()), 0);
+        EXPECT_TRUE(WaitReloads(&reloads, 4));
+        EXPECT_TRUE(reloader.LastResult().success);
+        EXPECT_EQ(*db.Read(), "girigiri");
+
+        // The readers block the update until timeout.
+        auto ptr = db.Get();
+        EXPECT_TRUE(reloader.Reload().get());
+        reloader.SetUpdateTimeout(std::chrono::milliseconds(10));
+        EXPECT_FALSE(reloader.Reload().get());
+        ptr.reset();
+
+        reloader.Stop();
+        WriteFile(path, "stopped");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        EXPECT_EQ(reloads, 6);
+    }
+    std::remove(path.c_str());
+    rmdir(dir);
+}
+
+TEST(ExceptionTest, BufferReloader) {
+    DoubleBuffer<std::string> db;
+    ThreadPool pool(1);
+    {
+        // The exception out of the callback goes to the future.
+        BufferReloader<std::string> reloader(&db, &pool, "/tmp/no_such_file",
+            [](const std::string&, std::string*) { return false; },
+            [](const ReloadResult&) { throw std::runtime_error("callback"); });
+        EXPECT_THROW(reloader.Reload().get(), std::runtime_error);
+    }
+    {
+        // Not derived from std::exception, so not caught by Load.
+        BufferReloader<std::string> reloader(&db, &pool, "/tmp/no_such_file",
+            [](const std::string&, std::string*) -> bool { throw 1; });
+        EXPECT_THROW(reloader.Reload().get(), int);
+    }
+    // The reloaders are destroyed without waiting forever.
+}
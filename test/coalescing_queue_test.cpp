@@ -0,0 +1,91 @@
+#include <iter/coalescing_queue.hpp>
+#include <iter/thread_pool.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace iter;
+
+TEST(ReplaceTest, CoalescingQueue) {
+    CoalescingQueue<std::string, int> queue;
+    EXPECT_TRUE(queue.Push("a", 1));
+    EXPECT_TRUE(queue.Push("b", 2));
+    EXPECT_TRUE(queue.Push("a", 3));
+    EXPECT_TRUE(queue.Push("c", 4));
+    EXPECT_TRUE(queue.Push("b", 5));
+    EXPECT_EQ(queue.Size(), 3);
+    EXPECT_EQ(queue.Coalesced(), 2);
+
+    // The position of the first push is kept.
+    std::string key;
+    int val = 0;
+    EXPECT_TRUE(queue.Pop(&key, &val));
+    EXPECT_EQ(key, "a");
+    EXPECT_EQ(val, 3);
+    EXPECT_TRUE(queue.Get(&key, &val));
+    EXPECT_EQ(key, "b");
+    EXPECT_EQ(val, 5);
+
+    // The key is pending again once it is fetched.
+    EXPECT_TRUE(queue.Push("a", 6));
+    auto all = queue.PopAll();
+    EXPECT_EQ(all->size(), 2);
+    EXPECT_EQ(all->front(), std::make_pair(std::string("c"), 4));
+    EXPECT_EQ(all->back(), std::make_pair(std::string("a"), 6));
+    EXPECT_TRUE(queue.Empty());
+
+    queue.Close();
+    EXPECT_FALSE(queue.Push("a", 7));
+    EXPECT_EQ(queue.GetFor(&key, &val, std::chrono::milliseconds(10)),
+        QueueStatus::kClosed);
+}
+
+struct SumMerge {
+    void operator () (int* pending, int&& incoming) const {
+        *pending += incoming;
+    }
+};
+
+TEST(MergeTest, CoalescingQueue) {
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(8));
+    CoalescingQueue<int, int, SumMerge> queue;
+
+    const int PUB = 4, SUB = 4, NUM = 10000, KEY = 16;
+
+    std::atomic<int> pub_done(0);
+    for (int pub = 0; pub < PUB; pub ++) {
+        pool->PushTask([&queue, &pub_done] {
+            for (int i = 0; i < NUM; i ++) queue.Push(i % KEY, 1);
+            if (++ pub_done == PUB) queue.Close();
+        });
+    }
+
+    std::atomic<int> fetched(0);
+    std::map<int, int> sum;
+    std::mutex mtx;
+    for (int sub = 0; sub < SUB; sub ++) {
+        pool->PushTask([&queue, &fetched, &sum, &mtx] {
+            int key = 0, val = 0;
+            while (queue.Get(&key, &val)) {
+                fetched ++;
+                std::lock_guard<std::mutex> lck(mtx);
+                sum[key] += val;
+            }
+        });
+    }
+
+    // Wait for all task finished.
+    pool.reset();
+
+    // Nothing is lost while the duplicated keys are merged.
+    for (int key = 0; key < KEY; key ++) {
+        EXPECT_EQ(sum[key], PUB * NUM / KEY);
+    }
+    EXPECT_EQ(fetched + queue.Coalesced(), uint64_t(PUB * NUM));
+}
@@ -0,0 +1,108 @@
+#include <iter/delay_queue.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace iter;
+
+TEST(OrderTest, DelayQueue) {
+    DelayQueue<int> delay_queue;
+    TimeKeeper tk;
+    delay_queue.Push(3, std::chrono::milliseconds(300));
+    delay_queue.Push(1, std::chrono::milliseconds(100));
+    delay_queue.Push(2, std::chrono::milliseconds(200));
+    delay_queue.Push(0, DelayQueue<int>::Clock::now());
+    EXPECT_EQ(delay_queue.Size(), 4);
+
+    int ret = -1;
+    EXPECT_TRUE(delay_queue.Pop(&ret));
+    EXPECT_EQ(ret, 0);
+    // Not due yet.
+    EXPECT_FALSE(delay_queue.Pop(&ret));
+
+    // Check the order and the due time, the upper bound is only a generous
+    // one, the machine may be loaded.
+    for (int i = 1; i <= 3; i ++) {
+        EXPECT_TRUE(delay_queue.Get(&ret));
+        EXPECT_EQ(ret, i);
+        int elapsed = tk.GetElapsedTime();
+        EXPECT_GE(elapsed, i * 100);
+        EXPECT_LT(elapsed, i * 100 + 1000);
+    }
+    EXPECT_TRUE(delay_queue.Empty());
+}
+
+TEST(TimeoutTest, DelayQueue) {
+    DelayQueue<std::unique_ptr<int>> delay_queue;
+    std::unique_ptr<int> ret;
+    delay_queue.Push(std::unique_ptr<int>(new int(1)),
+        std::chrono::milliseconds(2000));
+
+    // The element is not due before the deadline. The upper bounds below
+    // are only generous ones, the machine may be loaded.
+    TimeKeeper tk;
+    EXPECT_EQ(delay_queue.GetFor(&ret, std::chrono::milliseconds(30)),
+        QueueStatus::kTimeout);
+    int elapsed = tk.GetElapsedTime();
+    EXPECT_GE(elapsed, 30);
+    EXPECT_LT(elapsed, 30 + 1000);
+
+    // An earlier element pushed while waiting wakes the consumer up.
+    std::thread pusher([&delay_queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        delay_queue.Push(std::unique_ptr<int>(new int(2)),
+            std::chrono::milliseconds(10));
+    });
+    tk.Reset();
+    EXPECT_EQ(delay_queue.GetFor(&ret, std::chrono::seconds(10)),
+        QueueStatus::kSuccess);
+    EXPECT_EQ(*ret, 2);
+    elapsed = tk.GetElapsedTime();
+    EXPECT_GE(elapsed, 20);
+    EXPECT_LT(elapsed, 20 + 1000);
+    pusher.join();
+
+    // The remaining element is still fetched after closed.
+    delay_queue.Close();
+    EXPECT_FALSE(delay_queue.Push(std::unique_ptr<int>(new int(3)),
+        std::chrono::milliseconds(0)));
+    EXPECT_TRUE(delay_queue.Get(&ret));
+    EXPECT_EQ(*ret, 1);
+    EXPECT_FALSE(delay_queue.Get(&ret));
+}
+
+TEST(ConcurrentTest, DelayQueue) {
+    DelayQueue<int> delay_queue;
+    const int SUB = 4, NUM = 200;
+
+    std::atomic<int> count(0), late(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&] {
+            int ret = 0;
+            while (delay_queue.Get(&ret)) count ++;
+        });
+    }
+
+    auto begin = DelayQueue<int>::Clock::now();
+    for (int i = 0; i < NUM; i ++) {
+        delay_queue.Push(i, begin + std::chrono::milliseconds(i % 50));
+    }
+    int ret = 0;
+    while (count < NUM) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_FALSE(delay_queue.Pop(&ret));
+    delay_queue.Close();
+    for (auto& t : thread_list) t.join();
+    EXPECT_EQ(count, NUM);
+    EXPECT_GE(DelayQueue<int>::Clock::now() - begin,
+        std::chrono::milliseconds(49));
+}
@@ -0,0 +1,249 @@
+#include <iter/double_buffer.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace iter;
+
+TEST(ReadTest, DoubleBuffer) {
+    DoubleBuffer<std::string> db;
+    EXPECT_TRUE(db.Update(std::string("girigiri")));
+
+    auto ptr = db.Read();
+    EXPECT_TRUE(static_cast<bool>(ptr));
+    EXPECT_EQ(*ptr, "girigiri");
+    EXPECT_EQ(ptr->size(), 8);
+
+    // The reader of the active buffer does not block one update.
+    EXPECT_TRUE(db.Update(std::string("bilibili")));
+    EXPECT_EQ(*db.Read(), "bilibili");
+    // But it holds the reserved one.
+    EXPECT_FALSE(db.Released());
+    EXPECT_FALSE(db.Update(std::string("failed")));
+    EXPECT_EQ(*ptr, "girigiri");
+
+    auto moved = std::move(ptr);
+    EXPECT_FALSE(static_cast<bool>(ptr));
+    EXPECT_FALSE(db.Released());
+    moved.Reset();
+    EXPECT_TRUE(db.Released());
+    EXPECT_TRUE(db.Update(std::string("girigiri")));
+    EXPECT_EQ(*db.Get(), "girigiri");
+}
+
+TEST(UpdateWaitTest, DoubleBuffer) {
+    DoubleBuffer<std::string> db;
+    EXPECT_TRUE(db.Update(std::string("girigiri")));
+    auto sp = db.Get();
+    EXPECT_TRUE(db.Update(std::string("bilibili")));
+
+    // Held by the shared pointer got by Get.
+    EXPECT_FALSE(db.UpdateWait(std::string("failed"), std::chrono::milliseconds(20)));
+    std::thread releaser([&sp] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        sp.reset();
+    });
+    EXPECT_TRUE(db.UpdateWait(std::string("girigiri"), std::chrono::seconds(10)));
+    releaser.join();
+    EXPECT_EQ(*db.Read(), "girigiri");
+
+    // Held by the pointer got by Read.
+    auto rp = db.Read();
+    EXPECT_TRUE(db.Update(std::string("bilibili")));
+    EXPECT_FALSE(db.UpdateWait(std::chrono::milliseconds(20)));
+    releaser = std::thread([&rp] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        rp.Reset();
+    });
+    std::unique_ptr<std::string> up(new std::string("girigiri"));
+    EXPECT_TRUE(db.UpdateWait(std::move(up), std::chrono::seconds(10)));
+    releaser.join();
+    EXPECT_EQ(*db.Get(), "girigiri");
+}
+
+TEST(LeaseTest, DoubleBuffer) {
+    std::shared_ptr<const std::string> sp;
+    {
+        DoubleBuffer<std::string> db;
+        EXPECT_TRUE(db.Update(std::string("girigiri")));
+        sp = db.Get();
+    }
+    // The buffer outlives the double buffer.
+    EXPECT_EQ(*sp, "girigiri");
+}
+
+TEST(DeltaTest, DoubleBuffer) {
+    typedef std::map<int, int> Table;
+    DoubleBuffer<Table> db;
+    for (int i = 0; i < 10; i ++) {
+        EXPECT_TRUE(db.UpdateDelta([i](Table* table) { (*table)[i] = i; }));
+        EXPECT_EQ(db.Read()->size(), i + 1);
+    }
+    // The reserved buffer misses the last delta only.
+    EXPECT_EQ(db.GetReservedBuffer()->size(), 9);
+
+    // The stale reserved buffer is copied from the active one.
+    Table table;
+    table[100] = 100;
+    EXPECT_TRUE(db.Update(table));
+    EXPECT_TRUE(db.UpdateDelta([](Table* table) { (*table)[101] = 101; }));
+    EXPECT_EQ(db.Read()->size(), 2);
+    EXPECT_TRUE(db.UpdateDelta([](Table* table) { table->erase(100); }));
+    EXPECT_EQ(db.Read()->size(), 1);
+    EXPECT_EQ(db.Read()->count(101), 1);
+
+    // The delta is discarded when the reserved buffer is held.
+    auto ptr = db.Get();
+    EXPECT_TRUE(db.UpdateDelta([](Table* table) { (*table)[102] = 102; }));
+    EXPECT_FALSE(db.UpdateDelta([](Table* table) { (*table)[103] = 103; }));
+    EXPECT_FALSE(db.UpdateDeltaWait([](Table* table) { (*table)[103] = 103; },
+        std::chrono::milliseconds(10)));
+    ptr.reset();
+    EXPECT_TRUE(db.UpdateDeltaWait([](Table* table) { (*table)[104] = 104; },
+        std::chrono::milliseconds(10)));
+    Table expect;
+    expect[101] = 101;
+    expect[102] = 102;
+    expect[104] = 104;
+    EXPECT_EQ(*db.Read(), expect);
+    EXPECT_TRUE(db.UpdateDelta([](Table*) {}));
+    EXPECT_EQ(*db.Read(), expect);
+}
+
+TEST(VersionTest, DoubleBuffer) {
+    DoubleBuffer<std::string> db;
+    EXPECT_EQ(db.Version(), 0);
+
+    uint64_t version = 100;
+    std::chrono::system_clock::time_point publish_time;
+    auto begin = std::chrono::system_clock::now();
+    EXPECT_TRUE(db.Update(std::string("girigiri")));
+    EXPECT_EQ(*db.Read(&version, &publish_time), "girigiri");
+    EXPECT_EQ(version, 1);
+    EXPECT_GE(publish_time, begin);
+    EXPECT_EQ(db.PublishTime(), publish_time);
+
+    // A derived cache rebuilds only when the version changes.
+    uint64_t cache_version = 0;
+    size_t cache = 0;
+    int rebuilds = 0;
+    auto lookup = [&] {
+        if (db.Version() != cache_version) {
+            cache = db.Get(&cache_version)->size();
+            rebuilds ++;
+        }
+        return cache;
+    };
+    EXPECT_EQ(lookup(), 8);
+    EXPECT_EQ(lookup(), 8);
+    EXPECT_EQ(rebuilds, 1);
+    EXPECT_TRUE(db.UpdateDelta([](std::string* str) { *str += "!"; }));
+    EXPECT_EQ(db.Version(), 2);
+    EXPECT_EQ(lookup(), 9);
+    EXPECT_EQ(rebuilds, 2);
+
+    // The failed update keeps the version.
+    auto ptr = db.Read();
+    EXPECT_TRUE(db.Update());
+    EXPECT_FALSE(db.Update());
+    EXPECT_EQ(db.Version(), 3);
+    db.Get(&version);
+    EXPECT_EQ(version, 3);
+}
+
+TEST(ConcurrentTest, DoubleBuffer) {
+    const int SUB = 4, NUM = 2000, SIZE = 64;
+    DoubleBuffer<std::vector<int>> db;
+    EXPECT_TRUE(db.Update(std::vector<int>(SIZE, 0)));
+
+    std::atomic<bool> stop(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&db, &stop, &torn, sub] {
+            while (!stop) {
+                // Alternate the two read paths.
+                if (sub % 2 == 0) {
+                    auto ptr = db.Read();
+                    if (std::count(ptr->begin(), ptr->end(), ptr->front())
+                            != static_cast<long>(ptr->size())) torn ++;
+                }
+                else {
+                    auto ptr = db.Get();
+                    if (std::count(ptr->begin(), ptr->end(), ptr->front())
+                            != static_cast<long>(ptr->size())) torn ++;
+                }
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (int i = 1; i <= NUM; i ++) {
+        std::vector<int> buffer(SIZE, i);
+        EXPECT_TRUE(db.UpdateWait(buffer, std::chrono::seconds(10)));
+    }
+    stop = true;
+    for (auto& t : thread_list) t.join();
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(db.Read()->front(), NUM);
+}
+
+// Return the read throughput in ops/ms.
+template<class Reader>
+double ReadThroughput(int thread_num, int num, Reader reader) {
+    TimeKeeper tk;
+    std::vector<std::thread> thread_list;
+    for (int i = 0; i < thread_num; i ++) {
+        thread_list.emplace_back([num, &reader] {
+            long sum = 0;
+            for (int j = 0; j < num; j ++) sum += reader();
+            EXPECT_EQ(sum, num);
+        });
+    }
+    for (auto& t : thread_list) t.join();
+    return thread_num * num / tk.GetElapsedTime<double>();
+}
+
+TEST(DeltaSpeedTest, DoubleBuffer) {
+    const int NUM = 100, SIZE = 1 << 20;
+    DoubleBuffer<std::vector<int>> db;
+    EXPECT_TRUE(db.Update(std::vector<int>(SIZE, 0)));
+    TimeKeeper tk;
+    for (int i = 0; i < NUM; i ++) {
+        std::vector<int> buffer = *db.Read();
+        buffer[i] = i;
+        EXPECT_TRUE(db.Update(std::move(buffer)));
+    }
+    std::cout << "Update " << NUM << " times by copy elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    tk.Reset();
+    for (int i = 0; i < NUM; i ++) {
+        EXPECT_TRUE(db.UpdateDelta([i](std::vector<int>* buffer) { (*buffer)[i] = i + 1; }));
+    }
+    std::cout << "Update " << NUM << " times by delta elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    EXPECT_EQ(db.Read()->at(NUM - 1), NUM);
+}
+
+TEST(SpeedTest, DoubleBuffer) {
+    const int NUM = 1000000;
+    DoubleBuffer<int> db;
+    EXPECT_TRUE(db.Update(1));
+    int max_thread = std::max(
+        static_cast<int>(std::thread::hardware_concurrency()), 4);
+    for (int thread_num = 1; thread_num <= max_thread; thread_num <<= 1) {
+        double get = ReadThroughput(thread_num, NUM, [&db] { return *db.Get(); });
+        double read = ReadThroughput(thread_num, NUM, [&db] { return *db.Read(); });
+        std::cout << thread_num << " readers, Get " << get
+            << " ops/ms, Read " << read << " ops/ms" << std::endl;
+    }
+}
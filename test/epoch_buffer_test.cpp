@@ -0,0 +1,139 @@
+#include <iter/epoch_buffer.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace iter;
+
+// Count the buffers alive.
+struct Counted {
+    static std::atomic<int> alive;
+    int val;
+
+    Counted() : val(0) { alive ++; }
+    Counted(int v) : val(v) { alive ++; }
+    Counted(const Counted& other) : val(other.val) { alive ++; }
+    ~Counted() { alive --; }
+};
+
+std::atomic<int> Counted::alive(0);
+
+TEST(ReclaimTest, EpochBuffer) {
+    {
+        EpochBuffer<Counted> eb(3);
+        EXPECT_EQ(eb.Read()->val, 0);
+
+        auto ptr = eb.Read();
+        eb.Update(Counted(1));
+        eb.Update(Counted(2));
+        EXPECT_EQ(eb.Read()->val, 2);
+        // The first version is held by the reader.
+        EXPECT_EQ(ptr->val, 0);
+        EXPECT_EQ(eb.Reclaim(), 3);
+        EXPECT_EQ(Counted::alive, 3);
+
+        ptr.Reset();
+        EXPECT_EQ(eb.Reclaim(), 1);
+        EXPECT_EQ(Counted::alive, 1);
+    }
+    EXPECT_EQ(Counted::alive, 0);
+}
+
+TEST(BoundTest, EpochBuffer) {
+    EpochBuffer<Counted> eb(2);
+    auto ptr = eb.Read();
+
+    std::atomic<int> updated(0);
+    std::thread updater([&eb, &updated] {
+        for (int i = 1; i <= 3; i ++) {
+            eb.Update(Counted(i));
+            updated ++;
+        }
+    });
+    // The second update has to wait for the held version before publishing.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(updated, 1);
+    EXPECT_EQ(eb.Read()->val, 1);
+    EXPECT_EQ(ptr->val, 0);
+    // The waiting update does not block the others, only the held version
+    // and the current one are alive.
+    EXPECT_EQ(eb.Reclaim(), 2);
+
+    ptr.Reset();
+    updater.join();
+    EXPECT_EQ(updated, 3);
+    EXPECT_EQ(eb.Read()->val, 3);
+    EXPECT_LE(eb.Reclaim(), 2);
+}
+
+TEST(BoundTest, EpochBufferWriters) {
+    const int PUB = 4;
+    {
+        EpochBuffer<Counted> eb(3);
+        // Hold the first version, so the writers reach the limit.
+        auto ptr = eb.Read();
+        std::atomic<int> updated(0);
+        std::vector<std::thread> writer_list;
+        for (int pub = 0; pub < PUB; pub ++) {
+            writer_list.emplace_back([&eb, &updated, pub] {
+                for (int i = 0; i < 2; i ++) {
+                    eb.Update(std::unique_ptr<Counted>(new Counted(pub)));
+                    updated ++;
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        // The versions of the concurrent writers are bounded together,
+        // only two more versions are published.
+        EXPECT_EQ(updated, 2);
+        EXPECT_EQ(eb.Reclaim(), 3);
+        // Besides, each waiting writer holds one version not published yet.
+        EXPECT_LE(Counted::alive, 3 + PUB);
+
+        ptr.Reset();
+        for (auto& t : writer_list) t.join();
+        EXPECT_EQ(updated, 2 * PUB);
+        EXPECT_LE(eb.Reclaim(), 3);
+    }
+    EXPECT_EQ(Counted::alive, 0);
+}
+
+TEST(ConcurrentTest, EpochBuffer) {
+    const int SUB = 4, NUM = 5000, SIZE = 64;
+    EpochBuffer<std::vector<int>> eb;
+    eb.Update(std::vector<int>(SIZE, 0));
+
+    std::atomic<bool> stop(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&eb, &stop, &torn] {
+            int last = 0;
+            while (!stop) {
+                auto ptr = eb.Read();
+                if (std::count(ptr->begin(), ptr->end(), ptr->front())
+                        != static_cast<long>(ptr->size())) torn ++;
+                // The versions are seen in order.
+                if (ptr->front() < last) torn ++;
+                last = ptr->front();
+                ptr.Reset();
+                std::this_thread::yield();
+            }
+        });
+    }
+    // Update never fails.
+    TimeKeeper tk;
+    for (int i = 1; i <= NUM; i ++) eb.Update(std::vector<int>(SIZE, i));
+    std::cout << "Update " << NUM << " versions elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    stop = true;
+    for (auto& t : thread_list) t.join();
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(eb.Read()->front(), NUM);
+}
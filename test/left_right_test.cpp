@@ -0,0 +1,129 @@
+#include <iter/left_right.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace iter;
+
+typedef std::map<int, int> Table;
+
+TEST(WriteTest, LeftRight) {
+    Table init;
+    init[0] = 0;
+    LeftRight<Table> lr(init);
+    EXPECT_EQ(lr.Read()->size(), 1);
+
+    for (int i = 1; i < 10; i ++) {
+        lr.Write([i](Table* table) { (*table)[i] = i; });
+        EXPECT_EQ(lr.Read()->size(), i + 1);
+    }
+    EXPECT_EQ(lr.Pending(), 1);
+    lr.Flush();
+    EXPECT_EQ(lr.Pending(), 0);
+
+    std::vector<LeftRight<Table>::OperationType> op_list;
+    op_list.emplace_back([](Table* table) { table->erase(0); });
+    op_list.emplace_back([](Table* table) { (*table)[10] = 10; });
+    lr.Write(op_list);
+    EXPECT_EQ(lr.Pending(), 2);
+    EXPECT_EQ(lr.Read([](const Table& table) { return table.count(0); }), 0);
+    EXPECT_EQ(lr.Read([](const Table& table) { return table.at(10); }), 10);
+
+    // Both instances converge.
+    lr.Write([](Table*) {});
+    auto left = *lr.Read();
+    lr.Write([](Table*) {});
+    EXPECT_EQ(*lr.Read(), left);
+    EXPECT_EQ(left.size(), 10);
+}
+
+TEST(ConcurrentTest, LeftRight) {
+    const int SUB = 4, NUM = 2000;
+    LeftRight<Table> lr;
+    std::atomic<bool> stop(false);
+    std::atomic<int> wrong(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&lr, &stop, &wrong] {
+            size_t last = 0;
+            while (!stop) {
+                auto ptr = lr.Read();
+                // The keys are written in order without holes.
+                if (!ptr->empty() && ptr->rbegin()->first + 1 !=
+                        static_cast<int>(ptr->size())) wrong ++;
+                if (ptr->size() < last) wrong ++;
+                last = ptr->size();
+                ptr.Reset();
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (int i = 0; i < NUM; i ++) {
+        lr.Write([i](Table* table) { (*table)[i] = i; });
+    }
+    stop = true;
+    for (auto& t : thread_list) t.join();
+    EXPECT_EQ(wrong, 0);
+    EXPECT_EQ(lr.Read()->size(), NUM);
+}
+
+// Read with thread_num readers while one writer keeps writing, return
+// the read throughput in ops/ms.
+template<class Reader, class Writer>
+double ReadThroughput(int thread_num, int num, Reader reader, Writer writer) {
+    std::atomic<bool> stop(false);
+    std::thread writer_thread([&stop, &writer] {
+        for (int i = 0; !stop; i ++) {
+            writer(i);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+    TimeKeeper tk;
+    std::vector<std::thread> thread_list;
+    for (int i = 0; i < thread_num; i ++) {
+        thread_list.emplace_back([num, &reader] {
+            for (int j = 0; j < num; j ++) reader(j);
+        });
+    }
+    for (auto& t : thread_list) t.join();
+    double throughput = thread_num * num / tk.GetElapsedTime<double>();
+    stop = true;
+    writer_thread.join();
+    return throughput;
+}
+
+TEST(SpeedTest, LeftRight) {
+    const int NUM = 200000, SIZE = 1024;
+    Table init;
+    for (int i = 0; i < SIZE; i ++) init[i] = i;
+    int max_thread = std::max(
+        static_cast<int>(std::thread::hardware_concurrency()), 4);
+    for (int thread_num = 1; thread_num <= max_thread; thread_num <<= 1) {
+        Table table = init;
+        std::mutex mtx;
+        double locked = ReadThroughput(thread_num, NUM,
+            [&table, &mtx](int i) {
+                std::lock_guard<std::mutex> lck(mtx);
+                return table.find(i % SIZE)->second;
+            },
+            [&table, &mtx](int i) {
+                std::lock_guard<std::mutex> lck(mtx);
+                table[i % SIZE] = i;
+            });
+        LeftRight<Table> lr(init);
+        double left_right = ReadThroughput(thread_num, NUM,
+            [&lr](int i) { return lr.Read()->find(i % SIZE)->second; },
+            [&lr](int i) {
+                lr.Write([i](Table* table) { (*table)[i % SIZE] = i; });
+            });
+        std::cout << thread_num << " readers, mutex " << locked
+            << " ops/ms, LeftRight " << left_right << " ops/ms" << std::endl;
+    }
+}
@@ -0,0 +1,103 @@
+#include <iter/double_buffer.hpp>
+#include <iter/mapped_file.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace iter;
+
+std::string TestPath(const std::string& tag) {
+    return "/tmp/iter_mapped_file_test_" + tag + "_" + std::to_string(getpid());
+}
+
+// Write the table of uint64_t values from base to the file.
+void WriteTable(const std::string& path, uint64_t base, size_t num) {
+    std::vector<uint64_t> table(num);
+    for (size_t i = 0; i < num; i ++) table[i] = base + i;
+    std::ofstream fout(path, std::ios::binary);
+    fout.write(reinterpret_cast<const char*>(table.data()), num * sizeof(uint64_t));
+}
+
+TEST(MapTest, MappedFile) {
+    std::string path = TestPath("map");
+    WriteTable(path, 100, 16);
+
+    MappedFile file;
+    EXPECT_TRUE(file.Empty());
+    EXPECT_FALSE(file.Open(TestPath("none")));
+    ASSERT_TRUE(file.Open(path));
+    EXPECT_EQ(file.Path(), path);
+    EXPECT_EQ(file.Size(), 16 * sizeof(uint64_t));
+    EXPECT_EQ(*file.As<uint64_t>(), 100);
+    EXPECT_EQ(*file.As<uint64_t>(15 * sizeof(uint64_t)), 115);
+    EXPECT_TRUE(file.As<uint64_t>(15 * sizeof(uint64_t) + 1) == NULL);
+    EXPECT_TRUE(file.As<uint64_t>(100 * sizeof(uint64_t)) == NULL);
+
+    MappedFile moved(std::move(file));
+    EXPECT_TRUE(file.Empty());
+    EXPECT_EQ(*moved.As<uint64_t>(8), 101);
+    moved.Close();
+    EXPECT_TRUE(moved.Empty());
+
+    // The empty file is mapped as empty.
+    WriteTable(path, 0, 0);
+    EXPECT_TRUE(moved.Open(path));
+    EXPECT_TRUE(moved.Empty());
+    std::remove(path.c_str());
+}
+
+TEST(DoubleBufferTest, MappedFile) {
+    const size_t NUM = 1 << 21;
+    std::string path = TestPath("swap");
+    std::string tmp_path = TestPath("swap_tmp");
+    DoubleBuffer<MappedFile> db;
+    EXPECT_TRUE(db.Read()->Empty());
+
+    WriteTable(path, 0, NUM);
+    TimeKeeper tk;
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    ASSERT_TRUE(file->Open(path));
+    EXPECT_TRUE(db.UpdateWait(std::move(file), std::chrono::seconds(1)));
+    std::cout << "Map and swap " << (NUM * sizeof(uint64_t) >> 20)
+        << " MB elapsed time " << tk.GetElapsedTime<double>() << " ms" << std::endl;
+
+    auto sp = db.Get();
+    EXPECT_EQ(*sp->As<uint64_t>((NUM - 1) * sizeof(uint64_t)), NUM - 1);
+
+    // Replace the file by rename, the old mapping is still valid.
+    WriteTable(tmp_path, 1000, NUM);
+    EXPECT_EQ(std::rename(tmp_path.c_str(), path.c_str()), 0);
+    file.reset(new MappedFile());
+    ASSERT_TRUE(file->Open(path));
+    EXPECT_TRUE(db.UpdateWait(std::move(file), std::chrono::seconds(1)));
+    EXPECT_EQ(*db.Read()->As<uint64_t>(), 1000);
+    EXPECT_EQ(*sp->As<uint64_t>(), 0);
+
+    // Unmap the old one once released.
+    EXPECT_FALSE(db.ClearReserved());
+    sp.reset();
+    EXPECT_TRUE(db.ClearReserved());
+    EXPECT_TRUE(db.GetReservedBuffer()->Empty());
+
+    tk.Reset();
+    std::vector<uint64_t> table(NUM);
+    std::ifstream fin(path, std::ios::binary);
+    fin.read(reinterpret_cast<char*>(table.data()), NUM * sizeof(uint64_t));
+    std::cout << "Read " << (NUM * sizeof(uint64_t) >> 20)
+        << " MB into heap elapsed time " << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    // The mapping sees the same content as the read.
+    EXPECT_EQ(std::memcmp(db.Read()->Data(), table.data(), NUM * sizeof(uint64_t)), 0);
+    std::remove(path.c_str());
+}
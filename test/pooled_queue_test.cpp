@@ -0,0 +1,118 @@
+#include <iter/pooled_queue.hpp>
+#include <iter/thread_pool.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace iter;
+
+TEST(FifoTest, PooledQueue) {
+    PooledQueue<std::string, 4> queue;
+    EXPECT_TRUE(queue.empty());
+    for (int i = 0; i < 10; i ++) queue.push(std::to_string(i));
+    EXPECT_EQ(queue.size(), 10);
+    EXPECT_EQ(queue.back(), "9");
+    EXPECT_EQ(queue.capacity(), 12);
+    EXPECT_EQ(queue.alloc_count(), 3);
+    for (int i = 0; i < 10; i ++) {
+        EXPECT_EQ(queue.front(), std::to_string(i));
+        queue.pop();
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(ReuseTest, PooledQueue) {
+    PooledQueue<std::shared_ptr<int>, 16> queue;
+    std::shared_ptr<int> ptr(new int(1));
+    queue.reserve(100);
+    uint64_t alloc_count = queue.alloc_count();
+
+    // Push and pop in steady state without allocation.
+    for (int round = 0; round < 1000; round ++) {
+        for (int i = 0; i < 100; i ++) queue.push(ptr);
+        EXPECT_EQ(ptr.use_count(), 101);
+        for (int i = 0; i < 100; i ++) queue.pop();
+    }
+    EXPECT_EQ(queue.alloc_count(), alloc_count);
+    EXPECT_EQ(ptr.use_count(), 1);
+
+    // The remaining elements are destroyed with the queue.
+    {
+        PooledQueue<std::shared_ptr<int>> tmp_queue;
+        for (int i = 0; i < 10; i ++) tmp_queue.emplace(ptr);
+        EXPECT_EQ(ptr.use_count(), 11);
+    }
+    EXPECT_EQ(ptr.use_count(), 1);
+}
+
+// Throw when constructed from a negative number.
+struct Checked {
+    explicit Checked(int v) : val(v) {
+        if (v < 0) throw std::invalid_argument("negative");
+    }
+    int val;
+};
+
+TEST(ExceptionTest, PooledQueue) {
+    PooledQueue<Checked, 4> queue;
+    for (int i = 0; i < 4; i ++) queue.emplace(i);
+    queue.pop();
+    // The node is kept in the pool after the constructor throws.
+    for (int i = 0; i < 100; i ++) {
+        EXPECT_THROW(queue.emplace(-1), std::invalid_argument);
+    }
+    EXPECT_EQ(queue.size(), 3);
+    queue.emplace(4);
+    EXPECT_EQ(queue.capacity(), 4);
+    EXPECT_EQ(queue.alloc_count(), 1);
+    EXPECT_EQ(queue.front().val, 1);
+    EXPECT_EQ(queue.back().val, 4);
+}
+
+TEST(SafeQueueTest, PooledQueue) {
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(8));
+    PooledSafeQueue<std::unique_ptr<int>> safe_queue;
+
+    const int PUB = 4, SUB = 4, NUM = 10000;
+
+    std::atomic<int> pub_done(0);
+    for (int pub = 0; pub < PUB; pub ++) {
+        pool->PushTask([&safe_queue, &pub_done] {
+            for (int i = 0; i < NUM; i ++) {
+                safe_queue.Push(std::unique_ptr<int>(new int(i)));
+            }
+            if (++ pub_done == PUB) safe_queue.Close();
+        });
+    }
+
+    int count[NUM] = {};
+    std::mutex mtx;
+    for (int sub = 0; sub < SUB; sub ++) {
+        pool->PushTask([&safe_queue, &mtx, &count] {
+            std::unique_ptr<int> ret;
+            while (safe_queue.Get(&ret)) {
+                std::lock_guard<std::mutex> lck(mtx);
+                count[*ret] ++;
+            }
+        });
+    }
+
+    // Wait for all task finished.
+    pool.reset();
+
+    for (int i = 0; i < NUM; i ++) {
+        EXPECT_EQ(count[i], PUB);
+    }
+    // The pool never grows beyond the peak depth.
+    safe_queue.Inspect([](const PooledQueue<std::unique_ptr<int>>& queue) {
+        EXPECT_TRUE(queue.empty());
+        EXPECT_LE(queue.capacity(), PUB * NUM + 64);
+        EXPECT_EQ(queue.alloc_count() * 64, queue.capacity());
+    });
+}
@@ -0,0 +1,109 @@
+#include <iter/queue_selector.hpp>
+#include <iter/safe_queue.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+using namespace iter;
+
+TEST(SelectTest, QueueSelector) {
+    SafeQueue<int> int_queue;
+    SafeQueue<std::string> string_queue;
+    QueueSelector selector;
+    EXPECT_EQ(selector.Add(&int_queue), 0);
+    EXPECT_EQ(selector.Add(&string_queue), 1);
+    EXPECT_EQ(selector.Size(), 2);
+
+    int index = -1;
+    TimeKeeper tk;
+    EXPECT_EQ(selector.SelectFor(&index, std::chrono::milliseconds(30)),
+        QueueStatus::kTimeout);
+    // Only a generous upper bound, the machine may be loaded.
+    int elapsed = tk.GetElapsedTime();
+    EXPECT_GE(elapsed, 30);
+    EXPECT_LT(elapsed, 30 + 1000);
+
+    string_queue.Push("hello");
+    EXPECT_EQ(selector.Select(), 1);
+    std::string str;
+    EXPECT_TRUE(string_queue.Pop(&str));
+
+    // Woken up by the push to any queue.
+    std::thread pusher([&int_queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        int_queue.Push(1);
+    });
+    tk.Reset();
+    EXPECT_EQ(selector.SelectFor(&index, std::chrono::seconds(10)),
+        QueueStatus::kSuccess);
+    EXPECT_EQ(index, 0);
+    elapsed = tk.GetElapsedTime();
+    EXPECT_GE(elapsed, 20);
+    EXPECT_LT(elapsed, 20 + 1000);
+    pusher.join();
+
+    // The queues with data are selected in turn.
+    string_queue.Push("world");
+    EXPECT_EQ(selector.Select(), 1);
+    EXPECT_EQ(selector.Select(), 0);
+
+    int ret = 0;
+    EXPECT_TRUE(int_queue.Pop(&ret));
+    EXPECT_TRUE(string_queue.Pop(&str));
+
+    // Closed and drained queues are skipped.
+    int_queue.Close();
+    string_queue.Push("!");
+    string_queue.Close();
+    EXPECT_EQ(selector.Select(), 1);
+    EXPECT_TRUE(string_queue.Pop(&str));
+    EXPECT_EQ(selector.Select(), -1);
+}
+
+TEST(EventFdTest, SafeQueue) {
+    SafeQueue<int> queue_a, queue_b;
+    int epoll_fd = epoll_create1(0);
+    ASSERT_GE(epoll_fd, 0);
+    SafeQueue<int>* queue_list[] = {&queue_a, &queue_b};
+    for (int i = 0; i < 2; i ++) {
+        int fd = queue_list[i]->EventFd();
+        ASSERT_GE(fd, 0);
+        EXPECT_EQ(fd, queue_list[i]->EventFd());
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        EXPECT_EQ(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event), 0);
+    }
+
+    struct epoll_event events[2];
+    EXPECT_EQ(epoll_wait(epoll_fd, events, 2, 10), 0);
+
+    std::thread pusher([&queue_b] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue_b.Push(1);
+        queue_b.Push(2);
+    });
+    EXPECT_EQ(epoll_wait(epoll_fd, events, 2, 10000), 1);
+    EXPECT_EQ(events[0].data.u32, 1);
+    pusher.join();
+
+    // Readable until the queue is drained.
+    int ret = 0;
+    EXPECT_TRUE(queue_b.Pop(&ret));
+    EXPECT_EQ(epoll_wait(epoll_fd, events, 2, 10), 1);
+    EXPECT_TRUE(queue_b.Pop(&ret));
+    EXPECT_EQ(epoll_wait(epoll_fd, events, 2, 10), 0);
+
+    // Readable once closed.
+    queue_a.Close();
+    EXPECT_EQ(epoll_wait(epoll_fd, events, 2, 10), 1);
+    EXPECT_EQ(events[0].data.u32, 0);
+    close(epoll_fd);
+}
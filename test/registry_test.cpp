@@ -0,0 +1,300 @@
+#include <iter/concurrent_registry.hpp>
+#include <iter/registry.hpp>
+#include <iter/slot_registry.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace iter;
+
+TEST(RegisterTest, Registry) {
+    Registry<std::string> registry;
+    // The handles start from 1.
+    int handle = registry.Register(std::string("girigiri"));
+    EXPECT_EQ(handle, 1);
+    EXPECT_TRUE(registry.IsRegistered(handle));
+    EXPECT_EQ(registry.Get(handle), "girigiri");
+    registry.Remove(handle);
+    EXPECT_FALSE(registry.IsRegistered(handle));
+    EXPECT_THROW(registry.Get(handle), std::out_of_range);
+}
+
+TEST(RegisterTest, RegistryFind) {
+    Registry<std::pair<int, std::string>> registry;
+    // Constructed in place.
+    int handle = registry.Register(1, "girigiri");
+    EXPECT_EQ(registry.Register(std::make_pair(2, std::string("kira"))), handle + 1);
+
+    auto ptr = registry.Find(handle);
+    EXPECT_TRUE(bool(ptr));
+    EXPECT_EQ(ptr->first, 1);
+    ptr->second = "kirakira";
+    ptr.Reset();
+    EXPECT_FALSE(bool(ptr));
+    EXPECT_EQ(registry.Get(handle).second, "kirakira");
+
+    EXPECT_TRUE(registry.Visit(handle, [](std::pair<int, std::string>& node) {
+        node.first ++;
+    }));
+    EXPECT_EQ(registry.Get(handle).first, 2);
+
+    registry.Remove(handle);
+    EXPECT_FALSE(bool(registry.Find(handle)));
+    EXPECT_FALSE(registry.Visit(handle, [](std::pair<int, std::string>&) {}));
+}
+
+TEST(ConcurrentTest, RegistryFind) {
+    const int NUM = 2000;
+    Registry<int64_t> registry;
+    int handle = registry.Register(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < 4; sub ++) {
+        thread_list.emplace_back([&registry, handle, sub] {
+            for (int i = 0; i < NUM; i ++) {
+                if (sub % 2 == 0) {
+                    auto ptr = registry.Find(handle);
+                    ++ *ptr;
+                }
+                else {
+                    registry.Visit(handle, [](int64_t& node) { ++ node; });
+                }
+            }
+        });
+    }
+    for (auto& t : thread_list) t.join();
+    EXPECT_EQ(registry.Get(handle), 4 * NUM);
+}
+
+TEST(RegisterTest, SlotRegistry) {
+    SlotRegistry<std::string> registry;
+    std::vector<SlotRegistry<std::string>::Handle> handle_list;
+    for (int i = 0; i < 10; i ++) {
+        handle_list.push_back(registry.Register(std::to_string(i)));
+        EXPECT_NE(handle_list.back(), 0);
+    }
+    EXPECT_EQ(registry.Size(), 10);
+    EXPECT_FALSE(registry.IsRegistered(0));
+
+    // Remove the ones in the middle, the others are moved.
+    EXPECT_TRUE(registry.Remove(handle_list[3]));
+    EXPECT_TRUE(registry.Remove(handle_list[0]));
+    EXPECT_FALSE(registry.Remove(handle_list[3]));
+    EXPECT_EQ(registry.Size(), 8);
+    for (int i = 0; i < 10; i ++) {
+        if (i == 0 || i == 3) {
+            EXPECT_FALSE(registry.IsRegistered(handle_list[i]));
+            EXPECT_THROW(registry.Get(handle_list[i]), std::out_of_range);
+        }
+        else {
+            EXPECT_EQ(registry.Get(handle_list[i]), std::to_string(i));
+        }
+    }
+
+    // The slot is reused, and the stale handle is still invalid.
+    std::string node = "girigiri";
+    auto handle = registry.Register(node);
+    EXPECT_EQ(static_cast<uint32_t>(handle), static_cast<uint32_t>(handle_list[0]));
+    EXPECT_NE(handle, handle_list[0]);
+    EXPECT_FALSE(registry.IsRegistered(handle_list[0]));
+    EXPECT_EQ(registry.Get(handle), "girigiri");
+    EXPECT_FALSE(registry.IsRegistered(handle + 1000));
+}
+
+TEST(StaleTest, SlotRegistry) {
+    SlotRegistry<std::string> registry;
+    auto first = registry.Register("0");
+    auto second = registry.Register("1");
+    auto third = registry.Register("2");
+    EXPECT_TRUE(registry.Remove(first));
+    EXPECT_TRUE(registry.Remove(second));
+
+    // The handles of the next generation of the free slots are not
+    // registered, though the second slot links to a valid position.
+    const uint64_t GEN = uint64_t(1) << 32;
+    for (auto handle : {first + GEN, second + GEN}) {
+        EXPECT_FALSE(registry.IsRegistered(handle));
+        EXPECT_THROW(registry.Get(handle), std::out_of_range);
+        EXPECT_FALSE(registry.Remove(handle));
+    }
+    EXPECT_EQ(registry.Size(), 1);
+    EXPECT_EQ(registry.Get(third), "2");
+}
+
+TEST(RegisterTest, ConcurrentRegistry) {
+    ConcurrentRegistry<std::string> registry(4);
+    int handle = registry.Register(std::string("girigiri"));
+    EXPECT_EQ(handle, 1);
+    EXPECT_TRUE(registry.IsRegistered(handle));
+    auto node = registry.Get(handle);
+    EXPECT_EQ(*node, "girigiri");
+
+    EXPECT_TRUE(registry.Remove(handle));
+    EXPECT_FALSE(registry.Remove(handle));
+    EXPECT_FALSE(registry.IsRegistered(handle));
+    EXPECT_TRUE(registry.Get(handle) == nullptr);
+    // The node got is still valid.
+    EXPECT_EQ(*node, "girigiri");
+    EXPECT_EQ(registry.Size(), 0);
+}
+
+TEST(ConcurrentTest, ConcurrentRegistry) {
+    const int SUB = 4, NUM = 2000;
+    ConcurrentRegistry<int> registry;
+    std::atomic<bool> stop(false);
+    std::atomic<int> wrong(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&registry, &stop, &wrong] {
+            for (int i = 0; !stop; i = (i + 1) % NUM) {
+                // The node of handle h is h, if it is registered.
+                auto node = registry.Get(i + 1);
+                if (node != nullptr && *node != i + 1) wrong ++;
+                std::this_thread::yield();
+            }
+        });
+    }
+    std::vector<std::thread> writer_list;
+    for (int sub = 0; sub < 2; sub ++) {
+        writer_list.emplace_back([&registry, &wrong] {
+            for (int i = 0; i < NUM / 2; i ++) {
+                // The handles and the nodes are not in the same order between
+                // writers, register a placeholder and check it.
+                int handle = registry.Register(0);
+                if (!registry.IsRegistered(handle)) wrong ++;
+                if (!registry.Remove(handle)) wrong ++;
+            }
+        });
+    }
+    for (auto& t : writer_list) t.join();
+    stop = true;
+    for (auto& t : thread_list) t.join();
+    EXPECT_EQ(wrong, 0);
+    EXPECT_EQ(registry.Size(), 0);
+}
+
+TEST(SpeedTest, Registry) {
+    const int SIZE = 100000, NUM = 1000000;
+    Registry<int64_t> registry;
+    SlotRegistry<int64_t> slot_registry;
+    std::vector<int> handle_list;
+    std::vector<SlotRegistry<int64_t>::Handle> slot_handle_list;
+    for (int i = 0; i < SIZE; i ++) {
+        handle_list.push_back(registry.Register(i));
+        slot_handle_list.push_back(slot_registry.Register(i));
+    }
+    // Remove some to make holes.
+    for (int i = 0; i < SIZE; i += 3) {
+        registry.Remove(handle_list[i]);
+        slot_registry.Remove(slot_handle_list[i]);
+    }
+
+    TimeKeeper tk;
+    int64_t sum = 0;
+    for (int i = 0; i < NUM; i ++) {
+        int handle = handle_list[(i * 7919LL) % SIZE];
+        if (registry.IsRegistered(handle)) sum += registry.Get(handle);
+    }
+    std::cout << "Registry lookup " << NUM << " times elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    tk.Reset();
+    int64_t slot_sum = 0;
+    for (int i = 0; i < NUM; i ++) {
+        auto handle = slot_handle_list[(i * 7919LL) % SIZE];
+        if (slot_registry.IsRegistered(handle)) slot_sum += slot_registry.Get(handle);
+    }
+    std::cout << "SlotRegistry lookup " << NUM << " times elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    EXPECT_EQ(sum, slot_sum);
+}
+
+TEST(SpeedTest, ConcurrentRegistry) {
+    // Each register copies a shard, keep it small.
+    const int SIZE = 4096, NUM = 200000;
+    Registry<int64_t> registry;
+    ConcurrentRegistry<int64_t> concurrent_registry;
+    std::vector<int> handle_list;
+    for (int i = 0; i < SIZE; i ++) {
+        handle_list.push_back(registry.Register(i));
+        EXPECT_EQ(concurrent_registry.Register(i), handle_list.back());
+    }
+
+    for (int thread_num : {1, 2, 4}) {
+        std::atomic<int64_t> sum(0), concurrent_sum(0);
+        std::vector<std::thread> thread_list;
+        TimeKeeper tk;
+        for (int t = 0; t < thread_num; t ++) {
+            thread_list.emplace_back([&] {
+                int64_t local = 0;
+                for (int i = 0; i < NUM; i ++) {
+                    int handle = handle_list[(i * 7919LL) % SIZE];
+                    if (registry.IsRegistered(handle)) local += registry.Get(handle);
+                }
+                sum += local;
+            });
+        }
+        for (auto& t : thread_list) t.join();
+        std::cout << "Registry " << thread_num << " threads lookup " << NUM
+            << " times each elapsed time " << tk.GetElapsedTime<double>() << " ms" << std::endl;
+
+        thread_list.clear();
+        tk.Reset();
+        for (int t = 0; t < thread_num; t ++) {
+            thread_list.emplace_back([&] {
+                int64_t local = 0;
+                for (int i = 0; i < NUM; i ++) {
+                    auto node = concurrent_registry.Get(handle_list[(i * 7919LL) % SIZE]);
+                    if (node != nullptr) local += *node;
+                }
+                concurrent_sum += local;
+            });
+        }
+        for (auto& t : thread_list) t.join();
+        std::cout << "ConcurrentRegistry " << thread_num << " threads lookup " << NUM
+            << " times each elapsed time " << tk.GetElapsedTime<double>() << " ms" << std::endl;
+        EXPECT_EQ(sum, concurrent_sum);
+    }
+}
+
+TEST(SpeedTest, RegistryFind) {
+    const int SIZE = 100, NUM = 20000;
+    // A heavyweight node.
+    Registry<std::vector<int64_t>> registry;
+    std::vector<int> handle_list;
+    for (int i = 0; i < SIZE; i ++) {
+        handle_list.push_back(registry.Register(1024, i));
+    }
+
+    TimeKeeper tk;
+    int64_t sum = 0;
+    for (int i = 0; i < NUM; i ++) {
+        sum += registry.Get(handle_list[i % SIZE])[i % 1024];
+    }
+    std::cout << "Registry Get " << NUM << " times elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    tk.Reset();
+    int64_t find_sum = 0;
+    for (int i = 0; i < NUM; i ++) {
+        find_sum += (*registry.Find(handle_list[i % SIZE]))[i % 1024];
+    }
+    std::cout << "Registry Find " << NUM << " times elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    tk.Reset();
+    int64_t visit_sum = 0;
+    for (int i = 0; i < NUM; i ++) {
+        registry.Visit(handle_list[i % SIZE], [&visit_sum, i](const std::vector<int64_t>& node) {
+            visit_sum += node[i % 1024];
+        });
+    }
+    std::cout << "Registry Visit " << NUM << " times elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    EXPECT_EQ(sum, find_sum);
+    EXPECT_EQ(sum, visit_sum);
+}
@@ -0,0 +1,81 @@
+#include <iter/ring_queue.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace iter;
+
+TEST(OverwriteTest, RingQueue) {
+    RingQueue<int> ring_queue(3);
+    EXPECT_EQ(ring_queue.Capacity(), 4);
+    EXPECT_TRUE(ring_queue.Empty());
+
+    int ret = -1;
+    EXPECT_FALSE(ring_queue.Pop(&ret));
+    for (int i = 0; i < 10; i ++) ring_queue.Push(i);
+    EXPECT_EQ(ring_queue.Size(), 4);
+
+    // Only the newest elements are kept.
+    for (int i = 6; i < 10; i ++) {
+        EXPECT_TRUE(ring_queue.Pop(&ret));
+        EXPECT_EQ(ret, i);
+    }
+    EXPECT_FALSE(ring_queue.Pop(&ret));
+    EXPECT_EQ(ring_queue.Dropped(), 6);
+
+    ring_queue.Push(10);
+    EXPECT_TRUE(ring_queue.Pop(&ret));
+    EXPECT_EQ(ret, 10);
+    EXPECT_EQ(ring_queue.Dropped(), 6);
+}
+
+struct Event {
+    int producer;
+    int seq;
+    int64_t payload[6];
+};
+
+TEST(ConcurrentTest, RingQueue) {
+    RingQueue<Event> ring_queue(256);
+    const int PUB = 4, NUM = 100000;
+
+    std::atomic<int> pub_done(0);
+    std::vector<std::thread> thread_list;
+    for (int pub = 0; pub < PUB; pub ++) {
+        thread_list.emplace_back([&ring_queue, &pub_done, pub] {
+            Event event;
+            event.producer = pub;
+            for (int i = 0; i < NUM; i ++) {
+                event.seq = i;
+                for (auto& p : event.payload) p = i * 31 + pub;
+                ring_queue.Push(event);
+            }
+            pub_done ++;
+        });
+    }
+
+    // A slow consumer.
+    uint64_t count = 0;
+    int last[PUB] = {-1, -1, -1, -1};
+    Event event;
+    while (pub_done < PUB || !ring_queue.Empty()) {
+        if (!ring_queue.Pop(&event)) {
+            std::this_thread::yield();
+            continue;
+        }
+        count ++;
+        // No torn element and the order of one producer is kept.
+        for (auto& p : event.payload) {
+            EXPECT_EQ(p, event.seq * 31 + event.producer);
+        }
+        EXPECT_GT(event.seq, last[event.producer]);
+        last[event.producer] = event.seq;
+    }
+    for (auto& t : thread_list) t.join();
+    while (ring_queue.Pop(&event)) count ++;
+
+    EXPECT_EQ(count + ring_queue.Dropped(), uint64_t(PUB * NUM));
+}
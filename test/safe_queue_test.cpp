@@ -1,13 +1,18 @@
 #include <iter/safe_queue.hpp>
 #include <iter/thread_pool.hpp>
+#include <iter/time_keeper.hpp>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <iterator>
 #include <thread>
 #include <chrono>
 #include <queue>
 #include <mutex>
 #include <memory>
+#include <vector>
 
 using namespace iter;
 
@@ -141,3 +146,332 @@ TEST(CopyTest, SafeQueue) {
     unique_int_queue.Pop(&ppp);
     EXPECT_EQ(*ppp, 10);
 }
+
+TEST(CloseTest, SafeQueue) {
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(8));
+    SafeQueue<int> safe_queue;
+
+    const int PUB = 4, SUB = 4, NUM = 10000;
+
+    std::atomic<int> pub_done(0);
+    for (int pub = 0; pub < PUB; pub ++) {
+        pool->PushTask([&safe_queue, &pub_done] {
+            for (int i = 0; i < NUM; i ++) {
+                EXPECT_TRUE(safe_queue.Push(i));
+            }
+            // The last producer sends the end-of-stream signal.
+            if (++ pub_done == PUB) safe_queue.Close();
+        });
+    }
+
+    int count[NUM] = {};
+    std::mutex mtx;
+    for (int sub = 0; sub < SUB; sub ++) {
+        pool->PushTask([&safe_queue, &mtx, &count] {
+            int ret = 0;
+            // Drain the queue until it is closed.
+            while (safe_queue.Get(&ret)) {
+                std::lock_guard<std::mutex> lck(mtx);
+                count[ret] ++;
+            }
+            EXPECT_TRUE(safe_queue.IsClosed());
+        });
+    }
+
+    // Wait for all task finished.
+    pool.reset();
+
+    for (int i = 0; i < NUM; i ++) {
+        EXPECT_EQ(count[i], PUB);
+    }
+
+    // Push to a closed queue is rejected.
+    EXPECT_FALSE(safe_queue.Push(1));
+    EXPECT_TRUE(safe_queue.Empty());
+    EXPECT_FALSE(safe_queue.Wait());
+}
+
+TEST(TimeoutTest, SafeQueue) {
+    // Only a generous upper bound, the machine may be loaded.
+    const int SLACK = 1000;
+    SafeQueue<int> safe_queue;
+    int ret = 0;
+
+    TimeKeeper tk;
+    EXPECT_EQ(safe_queue.GetFor(&ret, std::chrono::milliseconds(50)),
+        QueueStatus::kTimeout);
+    int elapsed = tk.GetElapsedTime();
+    EXPECT_GE(elapsed, 50);
+    EXPECT_LT(elapsed, 50 + SLACK);
+
+    tk.Reset();
+    EXPECT_FALSE(safe_queue.WaitFor(std::chrono::milliseconds(50)));
+    elapsed = tk.GetElapsedTime();
+    EXPECT_GE(elapsed, 50);
+    EXPECT_LT(elapsed, 50 + SLACK);
+
+    tk.Reset();
+    EXPECT_FALSE(safe_queue.Get(&ret, std::chrono::milliseconds(50)));
+    elapsed = tk.GetElapsedTime();
+    EXPECT_GE(elapsed, 50);
+    EXPECT_LT(elapsed, 50 + SLACK);
+
+    // Return immediately when the queue is not empty.
+    safe_queue.Push(1);
+    tk.Reset();
+    EXPECT_TRUE(safe_queue.WaitFor(std::chrono::seconds(10)));
+    EXPECT_EQ(safe_queue.GetUntil(&ret,
+        std::chrono::steady_clock::now() + std::chrono::seconds(10)),
+        QueueStatus::kSuccess);
+    EXPECT_EQ(ret, 1);
+    EXPECT_LT(tk.GetElapsedTime(), SLACK);
+
+    // Closed queue is distinguished from timeout.
+    std::thread closer([&safe_queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        safe_queue.Close();
+    });
+    tk.Reset();
+    EXPECT_EQ(safe_queue.GetFor(&ret, std::chrono::seconds(10)),
+        QueueStatus::kClosed);
+    EXPECT_LT(tk.GetElapsedTime(), 20 + SLACK);
+    closer.join();
+}
+
+TEST(WakeupLatencyTest, SafeQueue) {
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(12));
+    SafeQueue<std::chrono::steady_clock::time_point> safe_queue;
+
+    const int PUB = 4, SUB = 8, NUM = 200;
+
+    // Keep some threads busy to make the load.
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> load_list;
+    for (unsigned i = 0; i < std::thread::hardware_concurrency(); i ++) {
+        load_list.emplace_back([&stop] {
+            volatile long long x = 0;
+            while (!stop) x ++;
+        });
+    }
+
+    for (int pub = 0; pub < PUB; pub ++) {
+        pool->PushTask([&safe_queue] {
+            for (int i = 0; i < NUM; i ++) {
+                safe_queue.Push(std::chrono::steady_clock::now());
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    std::atomic<int> received(0), timeout(0);
+    std::atomic<long long> max_latency(0);
+    for (int sub = 0; sub < SUB; sub ++) {
+        pool->PushTask([&] {
+            using namespace std::chrono;
+            steady_clock::time_point pushed;
+            while (received < PUB * NUM) {
+                auto begin = steady_clock::now();
+                QueueStatus status = safe_queue.GetFor(
+                    &pushed, milliseconds(5));
+                auto now = steady_clock::now();
+                if (status == QueueStatus::kSuccess) {
+                    received ++;
+                    long long latency =
+                        duration_cast<microseconds>(now - pushed).count();
+                    long long cur = max_latency;
+                    while (latency > cur &&
+                        !max_latency.compare_exchange_weak(cur, latency));
+                }
+                else {
+                    EXPECT_EQ(status, QueueStatus::kTimeout);
+                    EXPECT_GE(now - begin, milliseconds(5));
+                    timeout ++;
+                }
+            }
+        });
+    }
+
+    // Wait for all task finished.
+    pool.reset();
+    stop = true;
+    for (auto& t : load_list) t.join();
+
+    EXPECT_EQ(received, PUB * NUM);
+    EXPECT_GT(timeout, 0);
+    std::cout << "Max wakeup latency " << max_latency << " us, "
+        << timeout << " timeouts" << std::endl;
+    // Only catch the lost wakeups, the machine may be loaded.
+    EXPECT_LT(max_latency, 1000000);
+}
+
+TEST(PriorityTest, SafeQueue) {
+    SafePriorityQueue<int> max_queue;
+    for (int i : {3, 1, 4, 1, 5, 9, 2, 6}) max_queue.Push(i);
+    int top = 0;
+    EXPECT_TRUE(max_queue.Front(&top));
+    EXPECT_EQ(top, 9);
+    std::vector<int> result;
+    int ret = 0;
+    while (max_queue.Pop(&ret)) result.push_back(ret);
+    EXPECT_EQ(result, std::vector<int>({9, 6, 5, 4, 3, 2, 1, 1}));
+
+    // Custom comparator and move only value.
+    struct Greater {
+        bool operator () (const std::unique_ptr<int>& a,
+                const std::unique_ptr<int>& b) const {
+            return *a > *b;
+        }
+    };
+    SafePriorityQueue<std::unique_ptr<int>, Greater> min_queue;
+    for (int i : {3, 1, 2}) min_queue.Push(std::unique_ptr<int>(new int(i)));
+    std::unique_ptr<int> ptr;
+    for (int i = 1; i <= 3; i ++) {
+        EXPECT_EQ(min_queue.GetFor(&ptr, std::chrono::milliseconds(10)),
+            QueueStatus::kSuccess);
+        EXPECT_EQ(*ptr, i);
+    }
+}
+
+TEST(StatsTest, SafeQueue) {
+    SafeQueue<int> safe_queue;
+    safe_queue.Push(0);
+    // The element pushed before enabled is not stamped.
+    safe_queue.EnableStats();
+    EXPECT_EQ(safe_queue.Size(), 1);
+
+    for (int i = 1; i <= 10; i ++) safe_queue.Push(i);
+    EXPECT_EQ(safe_queue.Size(), 11);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    int ret = 0;
+    for (int i = 0; i <= 5; i ++) EXPECT_TRUE(safe_queue.Pop(&ret));
+    auto all = safe_queue.PopAll();
+    EXPECT_EQ(all->size(), 5);
+    EXPECT_TRUE(safe_queue.Empty());
+
+    SafeQueueStats stats = safe_queue.GetStats();
+    EXPECT_EQ(stats.push_count, 10);
+    EXPECT_EQ(stats.pop_count, 11);
+    EXPECT_GT(stats.push_rate, 0);
+    EXPECT_EQ(stats.max_depth, 11);
+    // At least 10ms in the queue, the bucket is [8192, 16384) us.
+    EXPECT_GE(stats.time_in_queue_p50_us, 16384);
+    EXPECT_GE(stats.time_in_queue_p99_us, stats.time_in_queue_p50_us);
+
+    safe_queue.ResetStats();
+    stats = safe_queue.GetStats();
+    EXPECT_EQ(stats.push_count, 0);
+    EXPECT_EQ(stats.time_in_queue_p50_us, 0);
+
+    safe_queue.EnableStats(false);
+    safe_queue.Push(1);
+    EXPECT_EQ(safe_queue.GetStats().push_count, 0);
+}
+
+TEST(ContentionTest, SafeQueue) {
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(8));
+    SafeQueue<int> safe_queue;
+    safe_queue.EnableStats();
+
+    const int PUB = 4, SUB = 4, NUM = 100000;
+
+    std::atomic<int> pub_done(0);
+    for (int pub = 0; pub < PUB; pub ++) {
+        pool->PushTask([&safe_queue, &pub_done] {
+            for (int i = 0; i < NUM; i ++) safe_queue.Push(i);
+            if (++ pub_done == PUB) safe_queue.Close();
+        });
+    }
+    std::atomic<int> count(0);
+    for (int sub = 0; sub < SUB; sub ++) {
+        pool->PushTask([&safe_queue, &count] {
+            int ret = 0;
+            while (safe_queue.Get(&ret)) count ++;
+        });
+    }
+
+    TimeKeeper tk;
+    // Size and Empty are safe to call without lock.
+    size_t max_size = 0;
+    while (!safe_queue.IsClosed() || !safe_queue.Empty()) {
+        max_size = std::max<size_t>(max_size, safe_queue.Size());
+        std::this_thread::yield();
+    }
+    pool.reset();
+    double elapsed = tk.GetElapsedTime<double>();
+
+    EXPECT_EQ(count, PUB * NUM);
+    SafeQueueStats stats = safe_queue.GetStats();
+    EXPECT_EQ(stats.push_count, uint64_t(PUB * NUM));
+    EXPECT_EQ(stats.pop_count, uint64_t(PUB * NUM));
+    EXPECT_GE(stats.max_depth, max_size);
+    std::cout << "Elapsed time " << elapsed << " ms, push rate "
+        << stats.push_rate << "/s, lock contended " << stats.lock_contended
+        << " times, wait " << stats.lock_wait_ns / 1e6 << " ms, max depth "
+        << stats.max_depth << ", time in queue p50 "
+        << stats.time_in_queue_p50_us << " us, p99 "
+        << stats.time_in_queue_p99_us << " us" << std::endl;
+}
+
+TEST(BatchTest, SafeQueue) {
+    SafeQueue<std::unique_ptr<int>> safe_queue;
+    std::vector<std::unique_ptr<int>> batch;
+    for (int i = 0; i < 10; i ++) batch.emplace_back(new int(i));
+
+    const int SUB = 4;
+    std::atomic<int> count(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&safe_queue, &count] {
+            std::unique_ptr<int> ret;
+            while (safe_queue.Get(&ret)) count ++;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_TRUE(safe_queue.Push(std::make_move_iterator(batch.begin()),
+        std::make_move_iterator(batch.end())));
+    EXPECT_TRUE(batch[0] == nullptr);
+    while (count < 10) std::this_thread::yield();
+    safe_queue.Close();
+    for (auto& t : thread_list) t.join();
+    EXPECT_FALSE(safe_queue.Push(std::make_move_iterator(batch.begin()),
+        std::make_move_iterator(batch.end())));
+}
+
+// Push NUM elements and return the producer elapsed time in ms.
+double ProducerElapsedTime(int work_ns, bool batch) {
+    const int SUB = 4, NUM = 200000, BATCH = 16;
+    SafeQueue<int> safe_queue;
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&safe_queue, work_ns] {
+            int ret = 0;
+            while (safe_queue.Get(&ret)) {
+                auto end = std::chrono::steady_clock::now() +
+                    std::chrono::nanoseconds(work_ns);
+                while (std::chrono::steady_clock::now() < end);
+            }
+        });
+    }
+    std::vector<int> vals(BATCH);
+    TimeKeeper tk;
+    for (int i = 0; i < NUM; i += batch ? BATCH : 1) {
+        if (batch) safe_queue.Push(vals.begin(), vals.end());
+        else safe_queue.Push(i);
+    }
+    double elapsed = tk.GetElapsedTime<double>();
+    safe_queue.Close();
+    for (auto& t : thread_list) t.join();
+    return elapsed;
+}
+
+TEST(SpeedTest, SafeQueue) {
+    // Busy consumers are rarely waiting, so push seldom notifies.
+    std::cout << "Push with busy consumers elapsed time "
+        << ProducerElapsedTime(2000, false) << " ms" << std::endl;
+    std::cout << "Push with idle consumers elapsed time "
+        << ProducerElapsedTime(0, false) << " ms" << std::endl;
+    std::cout << "Batch push with idle consumers elapsed time "
+        << ProducerElapsedTime(0, true) << " ms" << std::endl;
+}
@@ -0,0 +1,124 @@
+#include <iter/sharded_queue.hpp>
+#include <iter/safe_queue.hpp>
+#include <iter/thread_pool.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace iter;
+
+TEST(FifoTest, ShardedQueue) {
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(8));
+    ShardedQueue<std::pair<int, int>> sharded_queue(4);
+    EXPECT_EQ(sharded_queue.LaneNum(), 4);
+
+    const int PUB = 4, SUB = 4, NUM = 10000;
+
+    std::atomic<int> pub_done(0);
+    for (int pub = 0; pub < PUB; pub ++) {
+        pool->PushTask([&sharded_queue, &pub_done, pub] {
+            for (int i = 0; i < NUM; i ++) {
+                EXPECT_TRUE(sharded_queue.Push(std::make_pair(pub, i)));
+            }
+            if (++ pub_done == PUB) sharded_queue.Close();
+        });
+    }
+
+    std::vector<std::vector<std::pair<int, int>>> result(SUB);
+    for (int sub = 0; sub < SUB; sub ++) {
+        pool->PushTask([&sharded_queue, &result, sub] {
+            std::pair<int, int> ret;
+            while (sharded_queue.Get(&ret)) result[sub].push_back(ret);
+        });
+    }
+
+    // Wait for all task finished.
+    pool.reset();
+    EXPECT_TRUE(sharded_queue.Empty());
+
+    // Each consumer sees the elements of one producer in order.
+    int count[PUB] = {};
+    for (int sub = 0; sub < SUB; sub ++) {
+        int last[PUB];
+        std::fill(last, last + PUB, -1);
+        for (auto& p : result[sub]) {
+            EXPECT_GT(p.second, last[p.first]);
+            last[p.first] = p.second;
+            count[p.first] ++;
+        }
+    }
+    for (int pub = 0; pub < PUB; pub ++) EXPECT_EQ(count[pub], NUM);
+}
+
+TEST(TimeoutTest, ShardedQueue) {
+    ShardedQueue<int> sharded_queue(2);
+    int ret = 0;
+
+    TimeKeeper tk;
+    EXPECT_EQ(sharded_queue.GetFor(&ret, std::chrono::milliseconds(50)),
+        QueueStatus::kTimeout);
+    EXPECT_GE(tk.GetElapsedTime(), 50);
+
+    sharded_queue.PushToLane(1, 10);
+    EXPECT_EQ(sharded_queue.Size(), 1u);
+    EXPECT_EQ(sharded_queue.GetFor(&ret, std::chrono::milliseconds(50)),
+        QueueStatus::kSuccess);
+    EXPECT_EQ(ret, 10);
+
+    std::thread pusher([&sharded_queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        sharded_queue.Push(20);
+    });
+    tk.Reset();
+    EXPECT_TRUE(sharded_queue.Get(&ret));
+    EXPECT_EQ(ret, 20);
+    // Only a generous upper bound, the machine may be loaded.
+    EXPECT_LT(tk.GetElapsedTime(), 20 + 1000);
+    pusher.join();
+
+    sharded_queue.Close();
+    EXPECT_FALSE(sharded_queue.Push(30));
+    EXPECT_EQ(sharded_queue.GetFor(&ret, std::chrono::milliseconds(50)),
+        QueueStatus::kClosed);
+}
+
+template<class Queue>
+double Throughput(Queue* queue, int thread_num, int num) {
+    TimeKeeper tk;
+    std::vector<std::thread> thread_list;
+    for (int i = 0; i < thread_num; i ++) {
+        thread_list.emplace_back([queue, num] {
+            for (int j = 0; j < num; j ++) queue->Push(j);
+        });
+        thread_list.emplace_back([queue, num] {
+            int ret = 0;
+            for (int j = 0; j < num; j ++) queue->Get(&ret);
+        });
+    }
+    for (auto& t : thread_list) t.join();
+    return thread_num * num / tk.GetElapsedTime<double>();
+}
+
+TEST(SpeedTest, ShardedQueue) {
+    const int NUM = 100000;
+    int max_thread = std::max(
+        static_cast<int>(std::thread::hardware_concurrency()), 4);
+    for (int thread_num = 1; thread_num <= max_thread; thread_num <<= 1) {
+        SafeQueue<int> safe_queue;
+        ShardedQueue<int> sharded_queue;
+        double safe = Throughput(&safe_queue, thread_num, NUM);
+        double sharded = Throughput(&sharded_queue, thread_num, NUM);
+        std::cout << thread_num << " producers and consumers, SafeQueue "
+            << safe << " ops/ms, ShardedQueue " << sharded
+            << " ops/ms" << std::endl;
+    }
+}
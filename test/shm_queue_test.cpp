@@ -0,0 +1,172 @@
+#include <iter/shm_queue.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace iter;
+
+struct Record {
+    uint64_t seq;
+    char payload[48];
+};
+
+std::string ShmName(const std::string& tag) {
+    return "/iter_shm_queue_test_" + tag + "_" + std::to_string(getpid());
+}
+
+TEST(BasicTest, ShmQueue) {
+    std::string name = ShmName("basic");
+    ShmQueue<Record> shm_queue;
+    ASSERT_TRUE(shm_queue.Create(name, 3));
+    EXPECT_EQ(shm_queue.Capacity(), 4);
+
+    // The name is taken.
+    ShmQueue<Record> dup_queue;
+    EXPECT_FALSE(dup_queue.Create(name, 4));
+
+    // Another attachment of the same segment.
+    ShmQueue<Record> other_queue;
+    ASSERT_TRUE(other_queue.Open(name));
+    EXPECT_TRUE(ShmQueue<Record>::Unlink(name));
+
+    Record record;
+    for (uint64_t i = 0; i < 4; i ++) {
+        record.seq = i;
+        EXPECT_TRUE(shm_queue.TryPush(record));
+    }
+    EXPECT_FALSE(shm_queue.TryPush(record));
+    EXPECT_EQ(other_queue.Size(), 4);
+
+    for (uint64_t i = 0; i < 4; i ++) {
+        EXPECT_TRUE(other_queue.Pop(&record));
+        EXPECT_EQ(record.seq, i);
+    }
+    EXPECT_FALSE(other_queue.Pop(&record));
+
+    TimeKeeper tk;
+    EXPECT_EQ(other_queue.GetFor(&record, std::chrono::milliseconds(30)),
+        QueueStatus::kTimeout);
+    EXPECT_GE(tk.GetElapsedTime(), 30);
+
+    shm_queue.Close();
+    EXPECT_TRUE(other_queue.IsClosed());
+    EXPECT_FALSE(shm_queue.Push(record));
+    EXPECT_FALSE(other_queue.Get(&record));
+}
+
+TEST(CloseTest, ShmQueue) {
+    std::string name = ShmName("close");
+    const int PUB = 4, SUB = 2, ROUND = 20;
+    for (int round = 0; round < ROUND; round ++) {
+        ShmQueue<Record> shm_queue;
+        ASSERT_TRUE(shm_queue.Create(name, 1024));
+        EXPECT_TRUE(ShmQueue<Record>::Unlink(name));
+
+        // The pushes succeeded are all fetched, even if racing with Close.
+        std::atomic<int> pushed(0), fetched(0);
+        std::vector<std::thread> thread_list;
+        for (int pub = 0; pub < PUB; pub ++) {
+            thread_list.emplace_back([&shm_queue, &pushed] {
+                Record record;
+                record.seq = 0;
+                while (shm_queue.Push(record)) pushed ++;
+            });
+        }
+        for (int sub = 0; sub < SUB; sub ++) {
+            thread_list.emplace_back([&shm_queue, &fetched] {
+                Record record;
+                while (shm_queue.Get(&record)) fetched ++;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        shm_queue.Close();
+        for (auto& t : thread_list) t.join();
+        EXPECT_EQ(fetched, pushed);
+    }
+}
+
+TEST(DetachedTest, ShmQueue) {
+    ShmQueue<Record> shm_queue;
+    // The capacity can not be rounded up in 32 bits.
+    EXPECT_FALSE(shm_queue.Create(ShmName("huge"), ShmQueue<Record>::kMaxCapacity + 1));
+    EXPECT_FALSE(shm_queue.IsAttached());
+
+    // Fail instead of touching the segment.
+    Record record;
+    record.seq = 0;
+    EXPECT_EQ(shm_queue.Capacity(), 0);
+    EXPECT_EQ(shm_queue.Size(), 0);
+    EXPECT_TRUE(shm_queue.IsClosed());
+    EXPECT_FALSE(shm_queue.TryPush(record));
+    EXPECT_FALSE(shm_queue.Push(record));
+    EXPECT_FALSE(shm_queue.Pop(&record));
+    EXPECT_FALSE(shm_queue.Get(&record));
+    EXPECT_EQ(shm_queue.GetFor(&record, std::chrono::seconds(10)),
+        QueueStatus::kClosed);
+    shm_queue.Close();
+}
+
+TEST(CrossProcessTest, ShmQueue) {
+    std::string name = ShmName("cross");
+    const uint64_t NUM = 100000;
+
+    ShmQueue<Record> shm_queue;
+    ASSERT_TRUE(shm_queue.Create(name, 64));
+
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // The child process is the producer.
+        ShmQueue<Record> child_queue;
+        if (!child_queue.Open(name)) _exit(1);
+        Record record;
+        for (uint64_t i = 0; i < NUM; i ++) {
+            record.seq = i;
+            snprintf(record.payload, sizeof(record.payload), "%llu",
+                static_cast<unsigned long long>(i));
+            if (!child_queue.Push(record)) _exit(2);
+        }
+        child_queue.Close();
+        _exit(0);
+    }
+
+    Record record;
+    uint64_t count = 0;
+    int status = 0;
+    bool exited = false;
+    TimeKeeper tk;
+    while (true) {
+        QueueStatus ret = shm_queue.GetFor(&record, std::chrono::milliseconds(100));
+        if (ret == QueueStatus::kSuccess) {
+            EXPECT_EQ(record.seq, count);
+            EXPECT_EQ(std::string(record.payload), std::to_string(count));
+            count ++;
+            continue;
+        }
+        if (ret == QueueStatus::kClosed) break;
+        // Do not wait forever if the child is gone without closing it.
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            exited = true;
+            break;
+        }
+    }
+    std::cout << "Transfer " << NUM << " records elapsed time "
+        << tk.GetElapsedTime<double>() << " ms" << std::endl;
+    EXPECT_EQ(count, NUM);
+
+    if (!exited) waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_TRUE(ShmQueue<Record>::Unlink(name));
+}
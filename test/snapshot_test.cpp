@@ -0,0 +1,102 @@
+#include <iter/double_buffer.hpp>
+#include <iter/snapshot.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace iter;
+
+struct Config {
+    int threshold[7];
+    double ratio;
+};
+
+Config MakeConfig(int val) {
+    Config config;
+    std::fill(config.threshold, config.threshold + 7, val);
+    config.ratio = val;
+    return config;
+}
+
+TEST(StoreTest, Snapshot) {
+    Snapshot<Config> snapshot(MakeConfig(1));
+    EXPECT_EQ(snapshot.Version(), 0);
+    EXPECT_EQ(snapshot.Load().threshold[6], 1);
+
+    snapshot.Store(MakeConfig(2));
+    uint64_t version = 0;
+    Config config;
+    snapshot.Load(&config, &version);
+    EXPECT_EQ(version, 1);
+    EXPECT_EQ(config.threshold[0], 2);
+    EXPECT_EQ(config.ratio, 2);
+
+    // The size is not a multiple of the word.
+    Snapshot<char> ch;
+    EXPECT_EQ(ch.Load(), 0);
+    ch.Store('x');
+    EXPECT_EQ(ch.Load(), 'x');
+}
+
+TEST(ConcurrentTest, Snapshot) {
+    const int SUB = 4, NUM = 100000;
+    Snapshot<Config> snapshot(MakeConfig(0));
+    std::atomic<bool> stop(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> thread_list;
+    for (int sub = 0; sub < SUB; sub ++) {
+        thread_list.emplace_back([&snapshot, &stop, &torn] {
+            while (!stop) {
+                Config config = snapshot.Load();
+                if (std::count(config.threshold, config.threshold + 7,
+                        config.threshold[0]) != 7 ||
+                        config.ratio != config.threshold[0]) torn ++;
+            }
+        });
+    }
+    for (int i = 1; i <= NUM; i ++) snapshot.Store(MakeConfig(i));
+    stop = true;
+    for (auto& t : thread_list) t.join();
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(snapshot.Version(), NUM);
+}
+
+// Return the read throughput in ops/ms.
+template<class Reader>
+double ReadThroughput(int thread_num, int num, Reader reader) {
+    TimeKeeper tk;
+    std::vector<std::thread> thread_list;
+    for (int i = 0; i < thread_num; i ++) {
+        thread_list.emplace_back([num, &reader] {
+            double sum = 0;
+            for (int j = 0; j < num; j ++) sum += reader();
+            EXPECT_EQ(sum, num);
+        });
+    }
+    for (auto& t : thread_list) t.join();
+    return thread_num * num / tk.GetElapsedTime<double>();
+}
+
+TEST(SpeedTest, Snapshot) {
+    const int NUM = 1000000;
+    Snapshot<Config> snapshot(MakeConfig(1));
+    DoubleBuffer<Config> db;
+    EXPECT_TRUE(db.Update(MakeConfig(1)));
+    int max_thread = std::max(
+        static_cast<int>(std::thread::hardware_concurrency()), 4);
+    for (int thread_num = 1; thread_num <= max_thread; thread_num <<= 1) {
+        double get = ReadThroughput(thread_num, NUM, [&db] { return db.Get()->ratio; });
+        double read = ReadThroughput(thread_num, NUM, [&db] { return db.Read()->ratio; });
+        double load = ReadThroughput(thread_num, NUM,
+            [&snapshot] { return snapshot.Load().ratio; });
+        std::cout << thread_num << " readers, DoubleBuffer Get " << get
+            << " ops/ms, Read " << read << " ops/ms, Snapshot " << load
+            << " ops/ms" << std::endl;
+    }
+}
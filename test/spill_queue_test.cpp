@@ -0,0 +1,218 @@
+#include <iter/spill_queue.hpp>
+#include <iter/time_keeper.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace iter;
+
+std::string MakeTempDir() {
+    char path[] = "/tmp/iter_spill_queue_test_XXXXXX";
+    return mkdtemp(path) == NULL ? "" : path;
+}
+
+int CountFiles(const std::string& dir) {
+    int count = 0;
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) return -1;
+    while (struct dirent* entry = readdir(d)) {
+        if (entry->d_name[0] != '.') count ++;
+    }
+    closedir(d);
+    return count;
+}
+
+TEST(OrderTest, SpillQueue) {
+    std::string dir = MakeTempDir();
+    ASSERT_FALSE(dir.empty());
+    {
+        SpillQueue<std::string, StringSerializer> spill_queue(dir, 100, 4096);
+        const int NUM = 10000;
+        for (int round = 0; round < 2; round ++) {
+            for (int i = 0; i < NUM; i ++) {
+                EXPECT_TRUE(spill_queue.Push(std::to_string(i)));
+            }
+            EXPECT_EQ(spill_queue.Size(), NUM);
+            EXPECT_EQ(spill_queue.Spilled(), NUM - 100);
+            EXPECT_GT(CountFiles(dir), 1);
+
+            // Push while reading back.
+            std::string ret;
+            for (int i = 0; i < NUM / 2; i ++) {
+                EXPECT_TRUE(spill_queue.Pop(&ret));
+                EXPECT_EQ(ret, std::to_string(i));
+            }
+            for (int i = NUM; i < NUM + 10; i ++) {
+                EXPECT_TRUE(spill_queue.Push(std::to_string(i)));
+            }
+            for (int i = NUM / 2; i < NUM + 10; i ++) {
+                EXPECT_TRUE(spill_queue.Get(&ret));
+                EXPECT_EQ(ret, std::to_string(i));
+            }
+            EXPECT_TRUE(spill_queue.Empty());
+            EXPECT_EQ(CountFiles(dir), 0);
+        }
+
+        // Remaining segments are removed with the queue.
+        for (int i = 0; i < 1000; i ++) spill_queue.Push(std::to_string(i));
+        EXPECT_GT(CountFiles(dir), 0);
+    }
+    EXPECT_EQ(CountFiles(dir), 0);
+    rmdir(dir.c_str());
+}
+
+TEST(ConcurrentTest, SpillQueue) {
+    std::string dir = MakeTempDir();
+    ASSERT_FALSE(dir.empty());
+    const int PUB = 2, SUB = 2, NUM = 200000;
+    {
+        // The last segment is read while being written, the records of
+        // various sizes are split by the buffer of the writer.
+        SpillQueue<std::string, StringSerializer> spill_queue(dir, 16, 4 << 20);
+        std::vector<std::vector<int>> received(PUB * SUB);
+        std::vector<std::thread> consumer_list;
+        for (int sub = 0; sub < SUB; sub ++) {
+            consumer_list.emplace_back([&spill_queue, &received, sub] {
+                std::string val;
+                while (spill_queue.Get(&val)) {
+                    int pub = 0, seq = 0;
+                    if (sscanf(val.c_str(), "%d:%d:", &pub, &seq) != 2 ||
+                            pub < 0 || pub >= PUB) {
+                        ADD_FAILURE() << "Bad record " << val.substr(0, 32);
+                        continue;
+                    }
+                    // Keep the order of each producer seen by each consumer.
+                    received[pub * SUB + sub].push_back(seq);
+                }
+            });
+        }
+        std::vector<std::thread> producer_list;
+        for (int pub = 0; pub < PUB; pub ++) {
+            producer_list.emplace_back([&spill_queue, pub] {
+                for (int i = 0; i < NUM; i ++) {
+                    std::string val = std::to_string(pub) + ":" + std::to_string(i) + ":";
+                    val.append(i % 97, 'x');
+                    EXPECT_TRUE(spill_queue.Push(std::move(val)));
+                }
+            });
+        }
+        for (auto& t : producer_list) t.join();
+        spill_queue.Close();
+        for (auto& t : consumer_list) t.join();
+        EXPECT_EQ(spill_queue.Size(), 0);
+
+        // Every record arrives exactly once, in order for each consumer.
+        for (int pub = 0; pub < PUB; pub ++) {
+            std::vector<int> seq_list;
+            for (int sub = 0; sub < SUB; sub ++) {
+                auto& part = received[pub * SUB + sub];
+                EXPECT_TRUE(std::is_sorted(part.begin(), part.end()));
+                seq_list.insert(seq_list.end(), part.begin(), part.end());
+            }
+            std::sort(seq_list.begin(), seq_list.end());
+            ASSERT_EQ(seq_list.size(), static_cast<size_t>(NUM));
+            for (int i = 0; i < NUM; i ++) ASSERT_EQ(seq_list[i], i);
+        }
+    }
+    EXPECT_EQ(CountFiles(dir), 0);
+    rmdir(dir.c_str());
+}
+
+TEST(FailureTest, SpillQueue) {
+    std::string dir = MakeTempDir();
+    ASSERT_FALSE(dir.empty());
+    {
+        SpillQueue<std::string, StringSerializer> spill_queue(dir, 1);
+        // Discarded by the NULL result.
+        EXPECT_TRUE(spill_queue.Push("discarded"));
+        EXPECT_TRUE(spill_queue.Pop(NULL));
+        EXPECT_TRUE(spill_queue.Push("discarded"));
+        EXPECT_TRUE(spill_queue.Get(NULL));
+        EXPECT_TRUE(spill_queue.Push("discarded"));
+        EXPECT_EQ(spill_queue.GetUntil(NULL, std::chrono::steady_clock::now()),
+            QueueStatus::kSuccess);
+
+        // The records are buffered by the writer, less than the buffer
+        // size, and fail to be flushed beyond the file size limit.
+        struct rlimit old_limit;
+        ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &old_limit), 0);
+        struct rlimit limit = old_limit;
+        limit.rlim_cur = 0;
+        ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+        auto old_handler = signal(SIGXFSZ, SIG_IGN);
+        const int NUM = 20;
+        for (int i = 0; i <= NUM; i ++) {
+            EXPECT_TRUE(spill_queue.Push(std::string(100, 'a' + i % 26)));
+        }
+        EXPECT_EQ(spill_queue.Spilled(), NUM);
+
+        // The lost records are not waited for.
+        std::string val;
+        EXPECT_TRUE(spill_queue.Pop(&val));
+        EXPECT_EQ(val, std::string(100, 'a'));
+        EXPECT_FALSE(spill_queue.Pop(&val));
+        EXPECT_EQ(spill_queue.Lost(), NUM);
+        EXPECT_EQ(spill_queue.Size(), 0);
+        spill_queue.Close();
+        EXPECT_FALSE(spill_queue.Get(&val));
+
+        signal(SIGXFSZ, old_handler);
+        ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &old_limit), 0);
+    }
+    EXPECT_EQ(CountFiles(dir), 0);
+    rmdir(dir.c_str());
+}
+
+struct Record {
+    uint64_t seq;
+    char payload[248];
+};
+
+TEST(SpeedTest, SpillQueue) {
+    std::string dir = MakeTempDir();
+    ASSERT_FALSE(dir.empty());
+    SpillQueue<Record> spill_queue(dir, 1000);
+    const uint64_t NUM = 200000;
+
+    // A slow consumer catches up after the producer is done.
+    std::thread consumer([&spill_queue, NUM] {
+        Record record;
+        uint64_t count = 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        while (spill_queue.Get(&record)) {
+            EXPECT_EQ(record.seq, count);
+            count ++;
+        }
+        EXPECT_EQ(count, NUM);
+    });
+
+    Record record;
+    memset(&record, 'x', sizeof(record));
+    TimeKeeper tk;
+    for (uint64_t i = 0; i < NUM; i ++) {
+        record.seq = i;
+        EXPECT_TRUE(spill_queue.Push(record));
+    }
+    double elapsed = tk.GetElapsedTime<double>();
+    std::cout << "Push " << NUM << " records elapsed time " << elapsed
+        << " ms, spilled " << spill_queue.SpilledBytes() / 1000.0 / elapsed
+        << " MB/s" << std::endl;
+
+    spill_queue.Close();
+    consumer.join();
+    EXPECT_EQ(CountFiles(dir), 0);
+    rmdir(dir.c_str());
+}